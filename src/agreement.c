@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "agreement.h"
+#include "utils/log.h"
+
+/// the protocol gives up if robots have not agreed after this many rounds
+#define MAX_AGREEMENT_ROUNDS 8
+
+/// echo and ready multicasts counted for one target value
+typedef struct tally {
+    int x;
+    int y;
+    size_t echoes;
+    size_t readies;
+} Tally;
+
+/// what one robot has multicast during the protocol, as seen by every robot
+typedef struct record {
+    bool echoed;
+    bool readied;
+    bool conflicting;   // multicast two different values of the same kind
+    int echo_x, echo_y;
+    int ready_x, ready_y;
+} Record;
+
+/// protocol state a robot keeps for itself
+typedef struct robot_state {
+    bool echoed;
+    bool readied;
+    bool delivered;
+    int x;              // value the robot sent ready for
+    int y;
+} RobotState;
+
+/// the aggregated view of every multicast sent so far
+typedef struct view {
+    Tally* tallies;     // one entry per distinct value
+    size_t n_tallies;
+    Record* records;    // one entry per robot
+    bool got_send;      // the sender's announcement has been read
+    size_t sender;
+    int send_x, send_y;
+} View;
+
+/// find (or add) the tally of a value
+static Tally* getTally(View* view, int x, int y) {
+    for (size_t i=0; i<view->n_tallies; i++) {
+        if (view->tallies[i].x == x && view->tallies[i].y == y) {
+            return &view->tallies[i];
+        }
+    }
+    Tally* tally = &view->tallies[view->n_tallies++];
+    tally->x = x; tally->y = y;
+    tally->echoes = 0; tally->readies = 0;
+    return tally;
+}
+
+/// read the round's multicast log once and aggregate it for all robots
+/// only the first echo and first ready of each robot are counted
+static void aggregateRound(Network net, View* view) {
+    Message msg;
+    for (size_t i=0; peekMulticast(net, i, &msg); i++) {
+        Record* rec = &view->records[msg.sender];
+        switch (msg.type) {
+            case MSG_TARGET:
+                if (!view->got_send) {
+                    view->got_send = true;
+                    view->sender   = msg.sender;
+                    view->send_x   = msg.x;
+                    view->send_y   = msg.y;
+                }
+                break;
+            case MSG_ECHO:
+                if (!rec->echoed) {
+                    rec->echoed = true;
+                    rec->echo_x = msg.x; rec->echo_y = msg.y;
+                    getTally(view, msg.x, msg.y)->echoes++;
+                } else if (rec->echo_x != msg.x || rec->echo_y != msg.y) {
+                    rec->conflicting = true;
+                }
+                break;
+            case MSG_READY:
+                if (!rec->readied) {
+                    rec->readied = true;
+                    rec->ready_x = msg.x; rec->ready_y = msg.y;
+                    getTally(view, msg.x, msg.y)->readies++;
+                } else if (rec->ready_x != msg.x || rec->ready_y != msg.y) {
+                    rec->conflicting = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/// a malicious robot tries to make the others accept a phony target
+/// it echoes a phony value, equivocates by unicasting, and contradicts itself
+static void actMaliciously(Robot robot, Robot* robots, size_t k, View* view, int round) {
+    if (!view->got_send) {
+        return;
+    }
+    Message fake = { MSG_ECHO, robot->ID, 0, view->send_x + 1, view->send_y + 1 };
+    Message real = { MSG_ECHO, robot->ID, 0, view->send_x, view->send_y };
+    switch (round) {
+        case 1:
+            multicast(robot->inbox->net, fake);
+
+            // privately try to convince a random robot as well
+            fake.type = MSG_READY;
+            trySendMessage(robots[rng_below(&robot->rng, k)]->inbox, fake);
+            break;
+        case 2:
+            fake.type = MSG_READY;
+            multicast(robot->inbox->net, fake);
+            multicast(robot->inbox->net, real);
+            break;
+        default:
+            break;
+    }
+}
+
+/// a robot follows the protocol using the aggregated view of the previous round
+static void actHonestly(Robot robot, RobotState* state, View* view, size_t echo_quorum, size_t ready_quorum) {
+    // echo the sender's announcement
+    if (view->got_send && !state->echoed) {
+        Message msg = { MSG_ECHO, robot->ID, 0, view->send_x, view->send_y };
+        multicast(robot->inbox->net, msg);
+        state->echoed = true;
+    }
+
+    // become ready for a value enough robots echoed, or enough robots are ready for
+    if (!state->readied) {
+        for (size_t i=0; i<view->n_tallies; i++) {
+            Tally* tally = &view->tallies[i];
+            if (tally->echoes >= echo_quorum || tally->readies >= ready_quorum) {
+                Message msg = { MSG_READY, robot->ID, 0, tally->x, tally->y };
+                multicast(robot->inbox->net, msg);
+                state->readied = true;
+                state->x = tally->x;
+                state->y = tally->y;
+                break;
+            }
+        }
+    }
+}
+
+/// Broadcast target location to all other robots
+void broadcastTarget(Robot sender, Robot* robots, size_t k) {
+    Message msg = { MSG_TARGET, sender->ID, 0, sender->target->x, sender->target->y };
+    multicast(sender->inbox->net, msg);
+}
+
+/// All of the robots verify through consensus that they have the correct target
+AgreementStats verifyTarget(Robot* robots, size_t k) {
+    Network net = robots[0]->inbox->net;
+    unsigned long long messages = atomic_load(&net->messages);
+    unsigned long long bytes    = atomic_load(&net->bytes);
+
+    // thresholds for n robots of which at most f are malicious
+    size_t f = (k-1)/3;
+    size_t echo_quorum    = (k + f + 2) / 2;   // ceil((n+f+1)/2)
+    size_t ready_quorum   = f + 1;
+    size_t deliver_quorum = 2*f + 1;
+
+    View view;
+    view.tallies   = safemalloc((2*k + 1) * sizeof *(view.tallies), MEM_CONSENSUS);
+    view.n_tallies = 0;
+    view.records   = safecalloc(k, sizeof *(view.records), MEM_CONSENSUS);
+    view.got_send  = false;
+    RobotState* states = safecalloc(k, sizeof *states, MEM_CONSENSUS);
+
+    // the sender's announcement was multicast during this round
+    aggregateRound(net, &view);
+
+    AgreementStats stats = { false, 0, 0, 0, 0, 0, 0, 0 };
+    size_t pending = 0;
+    for (size_t i=0; i<k; i++) {
+        if (!robots[i]->malicious && !robots[i]->crashed) pending++;
+    }
+    while (pending > 0 && stats.rounds < MAX_AGREEMENT_ROUNDS) {
+        networkNextRound(net);
+        stats.rounds++;
+
+        // every robot sends based on what it learned last round
+        for (size_t i=0; i<k; i++) {
+            if (robots[i]->crashed) {
+                continue;
+            } else if (robots[i]->malicious) {
+                actMaliciously(robots[i], robots, k, &view, stats.rounds);
+            } else if (!states[i].delivered) {
+                actHonestly(robots[i], &states[i], &view, echo_quorum, ready_quorum);
+            }
+        }
+
+        // the round's multicasts are the same for every robot, so they are counted once
+        aggregateRound(net, &view);
+
+        for (size_t i=0; i<k; i++) {
+            if (robots[i]->malicious || robots[i]->crashed) {
+                continue;
+            }
+
+            // the protocol only uses multicasts, private messages give away the sender
+            Message msg;
+            while (receiveMessage(robots[i]->inbox, &msg)) {
+                if ((msg.type == MSG_ECHO || msg.type == MSG_READY) && msg.sender != robots[i]->ID) {
+                    robots[msg.sender]->accusations++;
+                }
+            }
+
+            // accept a value once enough robots are ready for it
+            if (!states[i].delivered) {
+                for (size_t t=0; t<view.n_tallies; t++) {
+                    if (view.tallies[t].readies >= deliver_quorum) {
+                        states[i].delivered = true;
+                        states[i].x = view.tallies[t].x;
+                        states[i].y = view.tallies[t].y;
+                        pending--;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // robots store the target they accepted
+    for (size_t i=0; i<k; i++) {
+        if (states[i].delivered) {
+            stats.delivered++;
+            stats.x = states[i].x;
+            stats.y = states[i].y;
+            if (robots[i]->target == NULL) {
+                robots[i]->target = safemalloc(sizeof *(robots[i]->target), MEM_ROBOTS);
+            }
+            robots[i]->target->x = states[i].x;
+            robots[i]->target->y = states[i].y;
+        }
+    }
+    stats.agreed = (pending == 0);
+
+    // robots accuse anyone whose multicasts contradict the accepted target
+    for (size_t j=0; j<k; j++) {
+        Record* rec = &view.records[j];
+        if (rec->conflicting
+                || (rec->echoed && (rec->echo_x != stats.x || rec->echo_y != stats.y))
+                || (rec->readied && (rec->ready_x != stats.x || rec->ready_y != stats.y))) {
+            robots[j]->accusations += stats.delivered;
+        }
+    }
+    for (size_t j=0; j<k; j++) {
+        // a robot which did not accept the target keeps the last value it heard of
+        if (robots[j]->target == NULL) {
+            Record* rec = &view.records[j];
+            robots[j]->target = safemalloc(sizeof *(robots[j]->target), MEM_ROBOTS);
+            robots[j]->target->x = rec->readied ? rec->ready_x : view.send_x;
+            robots[j]->target->y = rec->readied ? rec->ready_y : view.send_y;
+        }
+        if (robots[j]->accusations >= ready_quorum) {
+            robots[j]->suspected = true;
+            stats.flagged++;
+            log_info("Robot %zu found to be malicious by %zu robots!\n", robots[j]->ID, robots[j]->accusations);
+        }
+    }
+
+    stats.messages = atomic_load(&net->messages) - messages;
+    stats.bytes    = atomic_load(&net->bytes) - bytes;
+    safefree(view.tallies);
+    safefree(view.records);
+    safefree(states);
+    return stats;
+}
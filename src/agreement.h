@@ -0,0 +1,30 @@
+#ifndef CSCI251_PROJECT3_AGREEMENT_H
+#define CSCI251_PROJECT3_AGREEMENT_H
+
+#include <glob.h>
+#include "robot.h"
+
+/// outcome of one run of the target agreement protocol
+typedef struct agreement_stats {
+    bool agreed;                    // every robot following the protocol accepted the same target
+    int x;                          // the accepted target position
+    int y;
+    int rounds;                     // message rounds used by the protocol
+    size_t delivered;               // robots which accepted the target
+    size_t flagged;                 // robots found to be malicious
+    unsigned long long messages;    // messages delivered during the protocol
+    unsigned long long bytes;       // payload bytes delivered during the protocol
+} AgreementStats;
+
+/// have a robot broadcast it's target to all other robots
+/// the target is sent as a single multicast which starts the agreement protocol
+void broadcastTarget(Robot sender, Robot* robots, size_t k);
+
+/// All of the robots verify through consensus that they have the correct target
+/// Uses echo/ready reliable broadcast (Bracha) which tolerates up to (k-1)/3 malicious robots.
+/// Robots which send values contradicting the accepted target, send conflicting messages,
+/// or bypass the multicast channel are flagged as suspected.
+/// @returns the protocol's outcome and message counts
+AgreementStats verifyTarget(Robot* robots, size_t k);
+
+#endif //CSCI251_PROJECT3_AGREEMENT_H
@@ -0,0 +1,517 @@
+/**
+ * Snapshot format (all integers little-endian):
+ *
+ *   "RASC" magic, u32 version
+ *   u64 l, b, k, e; i64 seed; i32 phase, round
+ *   i32 target x, y; u64 leader ID
+ *   i32 turns without a heartbeat; u64 elections; i32 election rounds; u64 election messages
+ *   i32 network round; u64 messages, bytes, multicasts
+ *   u8 stall strategy; i32 round limit; u64 stalls; u8 timed out; u8 neighborhood (4 or 8)
+ *   u64 map deltas delivered, runs, cells, bytes, merged cells
+ *   u64 number of partitions n; n times u64 sweeps, per robot i32 region x0, y0, x1, y1
+ *   per robot:
+ *     u8 flags (malicious, suspected, has target, has assignment, crashed)
+ *     i32 self x, y; [i32 target x, y]; [i32 assignment x, y]
+ *     u64 accusations; u64 rng key, counter
+ *     u8 history length n; n times i32 x, y, oldest first
+ *     explored map as varint run lengths of alternating unknown/known cells
+ *     u8 has coverage; [u64 sweeps; i32 region x0, y0, x1, y1 explored by the robot]
+ *     varint delta sweep, length n; n times varint cell index
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "checkpoint.h"
+#include "simulation_internal.h"
+#include "spatial.h"
+#include "coverage.h"
+#include "mapping.h"
+#include "utils/log.h"
+
+#define CHECKPOINT_MAGIC "RASC"
+
+#define FLAG_MALICIOUS  1
+#define FLAG_SUSPECTED  2
+#define FLAG_TARGET     4
+#define FLAG_ASSIGNMENT 8
+#define FLAG_CRASHED    16
+
+/// growable byte buffer holding one snapshot
+typedef struct buffer {
+    unsigned char* data;
+    size_t size;
+    size_t cap;
+    size_t pos;     // read position when decoding
+    bool ok;        // false once a read ran past the end
+} Buffer;
+
+struct checkpointer {
+    char* path;
+    char* tmp_path;
+    Buffer buf;
+    pthread_t writer;
+    bool busy;      // a snapshot is being written
+};
+
+static void put_bytes(Buffer* buf, const void* data, size_t n) {
+    if (buf->size + n > buf->cap) {
+        buf->cap = (buf->size + n) * 2;
+        buf->data = saferealloc(buf->data, buf->cap, MEM_CHECKPOINT);
+    }
+    memcpy(buf->data + buf->size, data, n);
+    buf->size += n;
+}
+
+static void put_u64(Buffer* buf, uint64_t v) {
+    unsigned char bytes[8];
+    for (int i=0; i<8; i++) {
+        bytes[i] = (unsigned char) (v >> (8*i));
+    }
+    put_bytes(buf, bytes, 8);
+}
+
+static void put_u32(Buffer* buf, uint32_t v) {
+    unsigned char bytes[4];
+    for (int i=0; i<4; i++) {
+        bytes[i] = (unsigned char) (v >> (8*i));
+    }
+    put_bytes(buf, bytes, 4);
+}
+
+static void put_region(Buffer* buf, const Region* r) {
+    put_u32(buf, (uint32_t) r->x0);
+    put_u32(buf, (uint32_t) r->y0);
+    put_u32(buf, (uint32_t) r->x1);
+    put_u32(buf, (uint32_t) r->y1);
+}
+
+static void put_varint(Buffer* buf, uint64_t v) {
+    while (v >= 0x80) {
+        unsigned char byte = (unsigned char) (v | 0x80);
+        put_bytes(buf, &byte, 1);
+        v >>= 7;
+    }
+    unsigned char byte = (unsigned char) v;
+    put_bytes(buf, &byte, 1);
+}
+
+static const unsigned char* get_bytes(Buffer* buf, size_t n) {
+    if (!buf->ok || buf->pos + n > buf->size) {
+        buf->ok = false;
+        return NULL;
+    }
+    const unsigned char* bytes = buf->data + buf->pos;
+    buf->pos += n;
+    return bytes;
+}
+
+static uint64_t get_u64(Buffer* buf) {
+    const unsigned char* bytes = get_bytes(buf, 8);
+    uint64_t v = 0;
+    for (int i=0; bytes != NULL && i<8; i++) {
+        v |= (uint64_t) bytes[i] << (8*i);
+    }
+    return v;
+}
+
+static uint32_t get_u32(Buffer* buf) {
+    const unsigned char* bytes = get_bytes(buf, 4);
+    uint32_t v = 0;
+    for (int i=0; bytes != NULL && i<4; i++) {
+        v |= (uint32_t) bytes[i] << (8*i);
+    }
+    return v;
+}
+
+static uint64_t get_varint(Buffer* buf) {
+    uint64_t v = 0;
+    for (int shift=0; shift<64; shift+=7) {
+        const unsigned char* byte = get_bytes(buf, 1);
+        if (byte == NULL) {
+            return 0;
+        }
+        v |= (uint64_t) (*byte & 0x7f) << shift;
+        if (!(*byte & 0x80)) {
+            return v;
+        }
+    }
+    buf->ok = false;
+    return 0;
+}
+
+/// encode a robot's explored map as alternating run lengths, starting with unknown cells
+/// the cells are visited column by column, as they were when maps were stored that way
+static void put_explored(Buffer* buf, const bool* explored, size_t l, size_t b) {
+    bool value = false;
+    uint64_t run = 0;
+    for (size_t x=0; x<b; x++) {
+        for (size_t y=0; y<l; y++) {
+            if (explored[cellAt((int) x, (int) y, b)] != value) {
+                put_varint(buf, run);
+                value = !value;
+                run = 0;
+            }
+            run++;
+        }
+    }
+    put_varint(buf, run);
+}
+
+static void get_explored(Buffer* buf, bool* explored, size_t l, size_t b) {
+    bool value = false;
+    uint64_t run = get_varint(buf);
+    for (size_t x=0; x<b; x++) {
+        for (size_t y=0; y<l; y++) {
+            while (run == 0 && buf->ok) {
+                value = !value;
+                run = get_varint(buf);
+            }
+            explored[cellAt((int) x, (int) y, b)] = value;
+            run--;
+        }
+    }
+}
+
+/// copy the whole simulation state into a buffer
+static void encode(Buffer* buf, Simulation sim) {
+    put_bytes(buf, CHECKPOINT_MAGIC, 4);
+    put_u32(buf, CHECKPOINT_VERSION);
+    put_u64(buf, sim->l);
+    put_u64(buf, sim->b);
+    put_u64(buf, sim->k);
+    put_u64(buf, sim->e);
+    put_u64(buf, (uint64_t) sim->s);
+    put_u32(buf, (uint32_t) sim->phase);
+    put_u32(buf, (uint32_t) sim->round);
+    put_u32(buf, (uint32_t) sim->target->x);
+    put_u32(buf, (uint32_t) sim->target->y);
+    put_u64(buf, sim->leader->ID);
+    put_u32(buf, (uint32_t) sim->silent_turns);
+    put_u64(buf, sim->elections);
+    put_u32(buf, (uint32_t) sim->election_rounds);
+    put_u64(buf, sim->election_messages);
+    put_u32(buf, (uint32_t) sim->net->round);
+    put_u64(buf, atomic_load(&sim->net->messages));
+    put_u64(buf, atomic_load(&sim->net->bytes));
+    put_u64(buf, atomic_load(&sim->net->multicasts));
+    unsigned char strategy = (unsigned char) sim->stall_strategy, timed_out = sim->timed_out;
+    put_bytes(buf, &strategy, 1);
+    put_u32(buf, (uint32_t) sim->max_rounds);
+    put_u64(buf, sim->stalls);
+    put_bytes(buf, &timed_out, 1);
+    unsigned char moves = (unsigned char) sim->moves;
+    put_bytes(buf, &moves, 1);
+
+    ExchangeStats* ex = &sim->exchange->stats;
+    put_u64(buf, ex->packets);
+    put_u64(buf, ex->runs);
+    put_u64(buf, ex->cells);
+    put_u64(buf, ex->bytes);
+    put_u64(buf, ex->merged);
+
+    // the partitions are shared by every robot in their sweep, so each is stored once
+    size_t n_partitions = 0;
+    Partitions parts = sim->exchange->partitions;
+    for (Partition p = parts != NULL ? parts->list : NULL; p != NULL; p = p->next) {
+        n_partitions++;
+    }
+    put_u64(buf, n_partitions);
+    for (Partition p = parts != NULL ? parts->list : NULL; p != NULL; p = p->next) {
+        put_u64(buf, p->sweeps);
+        for (size_t r=0; r<sim->k; r++) {
+            put_region(buf, &p->regions[r]);
+        }
+    }
+
+    for (size_t j=0; j<sim->k; j++) {
+        Robot robot = sim->robots[j];
+        unsigned char flags = (unsigned char) ((robot->malicious ? FLAG_MALICIOUS : 0)
+                                               | (robot->suspected ? FLAG_SUSPECTED : 0)
+                                               | (robot->target != NULL ? FLAG_TARGET : 0)
+                                               | (robot->assignment != NULL ? FLAG_ASSIGNMENT : 0)
+                                               | (robot->crashed ? FLAG_CRASHED : 0));
+        put_bytes(buf, &flags, 1);
+        put_u32(buf, (uint32_t) robot->self->x);
+        put_u32(buf, (uint32_t) robot->self->y);
+        if (robot->target != NULL) {
+            put_u32(buf, (uint32_t) robot->target->x);
+            put_u32(buf, (uint32_t) robot->target->y);
+        }
+        if (robot->assignment != NULL) {
+            put_u32(buf, (uint32_t) robot->assignment->x);
+            put_u32(buf, (uint32_t) robot->assignment->y);
+        }
+        put_u64(buf, robot->accusations);
+        put_u64(buf, robot->rng.key);
+        put_u64(buf, robot->rng.counter);
+        unsigned char n_history = (unsigned char) (robot->n_history < STALL_WINDOW ? robot->n_history : STALL_WINDOW);
+        put_bytes(buf, &n_history, 1);
+        for (size_t i=robot->n_history-n_history; i<robot->n_history; i++) {
+            put_u32(buf, (uint32_t) robot->history[i % STALL_WINDOW].x);
+            put_u32(buf, (uint32_t) robot->history[i % STALL_WINDOW].y);
+        }
+        put_explored(buf, robot->explored, sim->l, sim->b);
+
+        // robots take over new regions as they finish theirs, so the regions are state
+        Coverage cov = robot->coverage;
+        unsigned char has_coverage = cov != NULL;
+        put_bytes(buf, &has_coverage, 1);
+        if (cov != NULL) {
+            put_u64(buf, cov->sweeps);
+            put_region(buf, &cov->region);
+        }
+        put_varint(buf, robot->delta->sweep);
+        put_varint(buf, robot->delta->n);
+        for (size_t i=0; i<robot->delta->n; i++) {
+            put_varint(buf, robot->delta->cells[i]);
+        }
+    }
+}
+
+/// read a region of a {l}x{b} grid, clearing {buf}'s ok flag if it is not on the grid
+static void get_region(Buffer* buf, Region* r, size_t l, size_t b) {
+    r->x0 = (int) get_u32(buf);
+    r->y0 = (int) get_u32(buf);
+    r->x1 = (int) get_u32(buf);
+    r->y1 = (int) get_u32(buf);
+    r->unknown = 0;
+    if (r->x0 < 0 || r->x1 < r->x0 || r->x1 > (int) b || r->y0 < 0 || r->y1 < r->y0 || r->y1 > (int) l) {
+        buf->ok = false;
+    }
+}
+
+/// read a position stored in the snapshot into a (possibly new) Position
+static Position get_position(Buffer* buf, Position pos) {
+    if (pos == NULL) {
+        pos = safemalloc(sizeof *pos, MEM_ROBOTS);
+    }
+    pos->x = (Coord) (int) get_u32(buf);
+    pos->y = (Coord) (int) get_u32(buf);
+    return pos;
+}
+
+/// write the buffered snapshot to a temporary file and move it over the previous one
+static void* writeSnapshot(void* cp_void) {
+    Checkpointer cp = (Checkpointer) cp_void;
+    FILE* file = fopen(cp->tmp_path, "wb");
+    if (file == NULL) {
+        log_error("Could not open checkpoint file %s\n", cp->tmp_path);
+        return NULL;
+    }
+    size_t written = fwrite(cp->buf.data, 1, cp->buf.size, file);
+    if (fclose(file) != 0 || written != cp->buf.size || rename(cp->tmp_path, cp->path) != 0) {
+        log_error("Could not write checkpoint file %s\n", cp->path);
+    }
+    return NULL;
+}
+
+/// create a checkpointer
+Checkpointer makeCheckpointer(const char* path) {
+    Checkpointer cp = safemalloc(sizeof *cp, MEM_CHECKPOINT);
+    cp->path     = safemalloc(strlen(path) + 1, MEM_CHECKPOINT);
+    cp->tmp_path = safemalloc(strlen(path) + 5, MEM_CHECKPOINT);
+    strcpy(cp->path, path);
+    sprintf(cp->tmp_path, "%s.tmp", path);
+    cp->buf.data = NULL;
+    cp->buf.size = 0;
+    cp->buf.cap  = 0;
+    cp->buf.pos  = 0;
+    cp->buf.ok   = true;
+    cp->busy     = false;
+    return cp;
+}
+
+/// wait for the snapshot currently being written
+static void waitCheckpoint(Checkpointer cp) {
+    if (cp->busy) {
+        pthread_join(cp->writer, NULL);
+        cp->busy = false;
+    }
+}
+
+/// snapshot a simulation in the background
+void saveCheckpoint(Checkpointer cp, Simulation sim) {
+    waitCheckpoint(cp);
+    cp->buf.size = 0;
+    encode(&cp->buf, sim);
+    if (pthread_create(&cp->writer, NULL, &writeSnapshot, cp) == 0) {
+        cp->busy = true;
+    } else {
+        writeSnapshot(cp);
+    }
+}
+
+/// free a checkpointer
+void freeCheckpointer(Checkpointer cp) {
+    waitCheckpoint(cp);
+    safefree(cp->buf.data);
+    safefree(cp->path);
+    safefree(cp->tmp_path);
+    safefree(cp);
+}
+
+/// restore a simulation from a snapshot
+Simulation loadCheckpoint(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        log_error("Could not open checkpoint file %s\n", path);
+        return NULL;
+    }
+    Buffer buf = { NULL, 0, 0, 0, true };
+    unsigned char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof chunk, file)) > 0) {
+        put_bytes(&buf, chunk, n);
+    }
+    fclose(file);
+
+    const unsigned char* magic = get_bytes(&buf, 4);
+    if (magic == NULL || memcmp(magic, CHECKPOINT_MAGIC, 4) != 0 || get_u32(&buf) != CHECKPOINT_VERSION) {
+        log_error("%s is not a version %d checkpoint\n", path, CHECKPOINT_VERSION);
+        safefree(buf.data);
+        return NULL;
+    }
+    size_t l = get_u64(&buf), b = get_u64(&buf), k = get_u64(&buf), e = get_u64(&buf);
+    long s   = (long) get_u64(&buf);
+    if (!buf.ok || l == 0 || b == 0 || !gridFits(l, b) || k == 0 || k >= l*b || !(k > 3*e+1 || k == 1)) {
+        log_error("%s has invalid simulation parameters\n", path);
+        safefree(buf.data);
+        return NULL;
+    }
+
+    // rebuild the simulation, then overwrite everything that changed since round 0
+    Simulation sim = makeSimulation(l, b, k, e, s);
+    sim->phase = (int) get_u32(&buf);
+    sim->round = (int) get_u32(&buf);
+    get_position(&buf, sim->target);
+    uint64_t leader = get_u64(&buf);
+    sim->leader = sim->robots[leader < k ? leader : 0];
+    sim->silent_turns      = (int) get_u32(&buf);
+    sim->elections         = get_u64(&buf);
+    sim->election_rounds   = (int) get_u32(&buf);
+    sim->election_messages = get_u64(&buf);
+    sim->net->round = (int) get_u32(&buf);
+    atomic_store(&sim->net->messages, get_u64(&buf));
+    atomic_store(&sim->net->bytes, get_u64(&buf));
+    atomic_store(&sim->net->multicasts, get_u64(&buf));
+    const unsigned char* strategy = get_bytes(&buf, 1);
+    sim->stall_strategy = strategy != NULL && *strategy <= STALL_REASSIGN ? (StallStrategy) *strategy : STALL_SWAP;
+    sim->max_rounds     = (int) get_u32(&buf);
+    sim->stalls         = get_u64(&buf);
+    const unsigned char* timed_out = get_bytes(&buf, 1);
+    sim->timed_out      = timed_out != NULL && *timed_out;
+    const unsigned char* moves = get_bytes(&buf, 1);
+    sim->moves          = moves != NULL && *moves == NEIGHBORHOOD_4 ? NEIGHBORHOOD_4 : NEIGHBORHOOD_8;
+    ExchangeStats* ex = &sim->exchange->stats;
+    ex->packets = get_u64(&buf);
+    ex->runs    = get_u64(&buf);
+    ex->cells   = get_u64(&buf);
+    ex->bytes   = get_u64(&buf);
+    ex->merged  = get_u64(&buf);
+
+    // the partitions are held until the robots in their sweeps took them over
+    Partitions parts = makePartitions(sim->robots, k, l, b);
+    sim->exchange->partitions = parts;
+    size_t n_partitions = get_u64(&buf);
+    if (n_partitions > k) {
+        buf.ok = false;
+        n_partitions = 0;
+    }
+    Partition* stored = safemalloc((n_partitions+1) * sizeof *stored, MEM_CHECKPOINT);
+    Region* regions = safemalloc(k * sizeof *regions, MEM_CHECKPOINT);
+    size_t n_stored = 0;
+    for (size_t i=0; i<n_partitions && buf.ok; i++) {
+        size_t sweeps = get_u64(&buf);
+        for (size_t r=0; r<k; r++) {
+            get_region(&buf, &regions[r], l, b);
+        }
+        if (buf.ok) {
+            stored[n_stored++] = sharePartition(parts, sweeps, regions);
+        }
+    }
+    safefree(regions);
+
+    for (size_t j=0; j<k && buf.ok; j++) {
+        Robot robot = sim->robots[j];
+        const unsigned char* flags = get_bytes(&buf, 1);
+        if (flags == NULL) {
+            break;
+        }
+        robot->malicious = (*flags & FLAG_MALICIOUS) != 0;
+        robot->suspected = (*flags & FLAG_SUSPECTED) != 0;
+        robot->crashed   = (*flags & FLAG_CRASHED) != 0;
+        get_position(&buf, robot->self);
+        if (*flags & FLAG_TARGET) {
+            robot->target = get_position(&buf, robot->target);
+        }
+        if (*flags & FLAG_ASSIGNMENT) {
+            robot->assignment = get_position(&buf, robot->assignment);
+        }
+        robot->accusations = get_u64(&buf);
+        robot->rng.key     = get_u64(&buf);
+        robot->rng.counter = get_u64(&buf);
+        const unsigned char* n_history = get_bytes(&buf, 1);
+        robot->n_history = n_history != NULL && *n_history <= STALL_WINDOW ? *n_history : 0;
+        for (size_t i=0; i<robot->n_history; i++) {
+            get_position(&buf, &robot->history[i]);
+        }
+        get_explored(&buf, robot->explored, l, b);
+
+        const unsigned char* coverage = get_bytes(&buf, 1);
+        if (coverage != NULL && *coverage) {
+            size_t sweeps = get_u64(&buf);
+            Region region;
+            get_region(&buf, &region, l, b);
+            bool found = false;
+            for (size_t i=0; i<n_stored; i++) {
+                found |= stored[i]->sweeps == sweeps;
+            }
+            buf.ok &= found;
+            if (buf.ok) {
+                Coverage cov = safemalloc(sizeof *cov, MEM_PLANNING);
+                cov->shared    = parts;
+                cov->id        = j;
+                cov->sweeps    = sweeps;
+                cov->partition = sharePartition(parts, sweeps, NULL);
+                cov->region    = region;
+                recountCoverage(cov, robot->explored);
+                robot->coverage = cov;
+            }
+        }
+        Delta delta = robot->delta;
+        delta->sweep = get_varint(&buf);
+        delta->n     = get_varint(&buf);
+        if (delta->n > l*b) {
+            buf.ok = false;
+            delta->n = 0;
+        }
+        if (delta->n > 0) {
+            delta->cap   = delta->n;
+            delta->cells = saferealloc(delta->cells, delta->cap * sizeof *(delta->cells), MEM_ROBOTS);
+        }
+        for (size_t i=0; i<delta->n; i++) {
+            uint64_t cell = get_varint(&buf);
+            if (cell >= l*b) {
+                buf.ok = false;
+                delta->n = 0;
+            }
+            delta->cells[i] = (Cell) cell;
+        }
+        spatialUpdate(sim->spatial, j);
+    }
+    safefree(buf.data);
+    for (size_t i=0; i<n_stored; i++) {
+        releasePartition(parts, stored[i]);
+    }
+    safefree(stored);
+
+    if (!buf.ok) {
+        log_error("%s is truncated\n", path);
+        freeSimulation(sim);
+        return NULL;
+    }
+    return sim;
+}
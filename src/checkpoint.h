@@ -0,0 +1,28 @@
+#ifndef CSCI251_PROJECT3_CHECKPOINT_H
+#define CSCI251_PROJECT3_CHECKPOINT_H
+
+#include "simulation.h"
+
+/// version of the snapshot format written by saveCheckpoint
+#define CHECKPOINT_VERSION 8
+
+/// writes snapshots of a simulation to a file in the background
+typedef struct checkpointer *Checkpointer;
+
+/// create a checkpointer which saves snapshots to {path}
+Checkpointer makeCheckpointer(const char* path);
+
+/// snapshot {sim} and write it out on a background thread
+/// the simulation is only held for the time it takes to copy its state into memory;
+/// if the previous snapshot is still being written, it is finished first
+void saveCheckpoint(Checkpointer cp, Simulation sim);
+
+/// wait for the pending snapshot (if any) and free the checkpointer
+void freeCheckpointer(Checkpointer cp);
+
+/// restore a simulation from the snapshot in {path}
+/// the restored simulation continues exactly as the saved one would have
+/// @returns the simulation, or NULL if the file is missing or not a valid snapshot
+Simulation loadCheckpoint(const char* path);
+
+#endif //CSCI251_PROJECT3_CHECKPOINT_H
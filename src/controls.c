@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "controls.h"
+#include "utils/safemalloc.h"
+
+/// how often the input thread checks whether it should stop, in milliseconds
+#define POLL_INTERVAL 100
+
+struct controls {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // signalled on every key, and when input runs dry
+    bool keyboard;              // whether the input thread runs
+    bool playing;
+    bool quit;
+    bool stopping;
+    int steps;                  // single steps requested while paused
+    double tick_rate;           // rounds per second while playing, 0 = as fast as possible
+    struct timespec next_tick;  // when the next round is due while playing
+};
+
+/// terminal settings to restore, shared with the exit handler
+static struct termios saved_termios;
+static bool raw_terminal = false;
+
+/// put the terminal back the way it was, also called on exit
+static void restoreTerminal(void) {
+    if (raw_terminal) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+        raw_terminal = false;
+    }
+}
+
+/// restore the terminal before a signal (e.g. Ctrl-C) ends the program
+static void restoreOnSignal(int sig) {
+    restoreTerminal();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/// deliver keys one at a time without echoing them, leaving output processing
+/// and signals (Ctrl-C) alone
+static void rawTerminal(void) {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_termios) != 0) {
+        return;
+    }
+    struct termios raw = saved_termios;
+    raw.c_lflag &= ~(tcflag_t) (ICANON | ECHO);
+    raw.c_cc[VMIN]  = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0) {
+        static bool registered = false;
+        if (!registered) {
+            atexit(&restoreTerminal);
+            signal(SIGINT, &restoreOnSignal);
+            signal(SIGTERM, &restoreOnSignal);
+            signal(SIGHUP, &restoreOnSignal);
+            registered = true;
+        }
+        raw_terminal = true;
+    }
+}
+
+static void addSeconds(struct timespec* t, double seconds) {
+    long ns = t->tv_nsec + (long) (seconds * 1e9);
+    t->tv_sec += ns / 1000000000L;
+    t->tv_nsec = ns % 1000000000L;
+}
+
+static bool before(const struct timespec* a, const struct timespec* b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/// apply a key to the playback state, the lock must be held
+static void pressKey(Controls c, int key) {
+    switch (key) {
+        case KEY_PLAY:
+            c->playing = !c->playing;
+            clock_gettime(CLOCK_MONOTONIC, &c->next_tick);
+            break;
+        case KEY_STEP:
+        case '\r':
+        case 's':
+            if (c->playing) {
+                c->playing = false;
+            } else {
+                c->steps++;
+            }
+            break;
+        case KEY_FASTER:
+        case '=':
+            if (c->tick_rate > 0) {
+                c->tick_rate = c->tick_rate*2 > TICK_RATE_MAX ? 0 : c->tick_rate*2;
+            }
+            break;
+        case KEY_SLOWER:
+            if (c->tick_rate == 0) {
+                c->tick_rate = TICK_RATE_MAX;
+            } else if (c->tick_rate/2 >= TICK_RATE_MIN) {
+                c->tick_rate /= 2;
+            }
+            break;
+        case KEY_QUIT:
+        case 'Q':
+            c->quit = true;
+            break;
+        default:
+            break;
+    }
+}
+
+/// input thread: read keys until stopped or stdin runs dry
+static void* readKeys(void* c_void) {
+    Controls c = (Controls) c_void;
+    struct pollfd in = { .fd = STDIN_FILENO, .events = POLLIN };
+    while (true) {
+        pthread_mutex_lock(&c->lock);
+        bool stopping = c->stopping;
+        pthread_mutex_unlock(&c->lock);
+        if (stopping) {
+            break;
+        }
+        if (poll(&in, 1, POLL_INTERVAL) <= 0) {
+            continue;
+        }
+
+        unsigned char key;
+        ssize_t n = read(STDIN_FILENO, &key, 1);
+        pthread_mutex_lock(&c->lock);
+        if (n <= 0) {
+            // nobody is left to press a key, so finish the simulation without waiting
+            c->playing   = true;
+            c->tick_rate = 0;
+        } else {
+            pressKey(c, key);
+        }
+        pthread_cond_broadcast(&c->changed);
+        pthread_mutex_unlock(&c->lock);
+        if (n <= 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/// start the controls
+Controls startControls(double tick_rate, bool playing, bool keyboard) {
+    Controls c = safemalloc(sizeof *c, MEM_DISPLAY);
+    c->keyboard  = keyboard;
+    c->playing   = playing;
+    c->quit      = false;
+    c->stopping  = false;
+    c->steps     = 0;
+    c->tick_rate = tick_rate;
+    clock_gettime(CLOCK_MONOTONIC, &c->next_tick);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&c->lock, NULL);
+
+    if (keyboard) {
+        rawTerminal();
+        int code = pthread_create(&c->thread, NULL, &readKeys, c);
+        if (code) {
+            printf("Thread creation failed!");
+            exit(code);
+        }
+    }
+    return c;
+}
+
+/// wait for the next round
+bool awaitTick(Controls c) {
+    pthread_mutex_lock(&c->lock);
+    bool step = false;
+    while (!c->quit && !step) {
+        if (c->steps > 0) {
+            c->steps--;
+            step = true;
+        } else if (c->playing && c->tick_rate == 0) {
+            step = true;
+        } else if (c->playing) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (before(&now, &c->next_tick)) {
+                pthread_cond_timedwait(&c->changed, &c->lock, &c->next_tick);
+                continue;
+            }
+            // keep a steady rate, but don't make up for ticks missed while a round took too long
+            addSeconds(&c->next_tick, 1.0 / c->tick_rate);
+            if (before(&c->next_tick, &now)) {
+                c->next_tick = now;
+                addSeconds(&c->next_tick, 1.0 / c->tick_rate);
+            }
+            step = true;
+        } else {
+            pthread_cond_wait(&c->changed, &c->lock);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return step;
+}
+
+/// describe the playback state
+void controlsStatus(Controls c, char* out, size_t size) {
+    pthread_mutex_lock(&c->lock);
+    char speed[32];
+    if (c->tick_rate == 0) {
+        snprintf(speed, sizeof speed, "as fast as possible");
+    } else {
+        snprintf(speed, sizeof speed, "%g rounds/s", c->tick_rate);
+    }
+    if (c->keyboard) {
+        snprintf(out, size, "%s at %s - [space] play/pause [enter] step [+/-] speed [q]uit",
+                 c->playing ? "Playing" : "Paused", speed);
+    } else {
+        snprintf(out, size, "Playing at %s", speed);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+/// stop the controls
+void stopControls(Controls c) {
+    if (c->keyboard) {
+        pthread_mutex_lock(&c->lock);
+        c->stopping = true;
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->thread, NULL);
+        restoreTerminal();
+    }
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->changed);
+    safefree(c);
+}
@@ -0,0 +1,38 @@
+#ifndef CSCI251_PROJECT3_CONTROLS_H
+#define CSCI251_PROJECT3_CONTROLS_H
+
+#include <glob.h>
+#include <stdbool.h>
+
+/// keys understood while the simulation is shown
+#define KEY_PLAY   ' '     // play or pause
+#define KEY_STEP   '\n'    // advance a single round (pauses playback)
+#define KEY_FASTER '+'     // double the tick rate
+#define KEY_SLOWER '-'     // halve the tick rate
+#define KEY_QUIT   'q'
+
+/// lowest and highest tick rate reachable with the speed keys, in rounds per second
+#define TICK_RATE_MIN 0.25
+#define TICK_RATE_MAX 1024.0
+
+/// playback state of the simulation, changed by an input thread reading the keyboard
+/// stdin is switched to unbuffered, non-echoing input if it is a terminal; once it runs dry
+/// the simulation is played to the end as fast as possible
+typedef struct controls *Controls;
+
+/// start reading keys from stdin, paused unless {playing} is set
+/// @param tick_rate rounds per second while playing, 0 to play as fast as possible
+/// @param keyboard whether to read keys at all, without it playback can only end by itself
+Controls startControls(double tick_rate, bool playing, bool keyboard);
+
+/// block until the next round is due: immediately for a single step, once per tick while playing
+/// @returns false if the user quit
+bool awaitTick(Controls controls);
+
+/// describe the playback state and the keys in a single line of at most {size}-1 characters
+void controlsStatus(Controls controls, char* out, size_t size);
+
+/// stop reading keys, restore the terminal and free the controls
+void stopControls(Controls controls);
+
+#endif //CSCI251_PROJECT3_CONTROLS_H
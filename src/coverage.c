@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include "coverage.h"
+#include "utils/log.h"
+
+/// a robot together with its coordinate along the axis a region is being cut across
+typedef struct sort_key {
+    int key;
+    size_t id;
+} SortKey;
+
+static int compareKeys(const void* a, const void* b) {
+    const SortKey* ka = a;
+    const SortKey* kb = b;
+    if (ka->key != kb->key) {
+        return ka->key < kb->key ? -1 : 1;
+    }
+    return ka->id < kb->id ? -1 : (ka->id > kb->id);
+}
+
+static size_t clamp(size_t v, size_t lo, size_t hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/// split {rect} among the {n} robots {ids}, cutting across the longer side so that
+/// the robots with the smaller coordinates get the part with the smaller coordinates
+/// {rect} must hold at least {n} cells
+static void bisect(Partitions parts, Region* regions, Region rect, size_t* ids, size_t n, SortKey* scratch) {
+    if (n == 1) {
+        regions[ids[0]] = rect;
+        return;
+    }
+    int w = rect.x1 - rect.x0, h = rect.y1 - rect.y0;
+    bool vertical = w >= h;
+    size_t side = (size_t) (vertical ? w : h), other = (size_t) (vertical ? h : w);
+
+    // cut in proportion to the robots on each side, while leaving every robot at least one cell
+    size_t n1  = n / 2;
+    size_t cut = clamp((side * n1 + n/2) / n, 1, side-1);
+    n1 = clamp(n1, n > (side-cut)*other ? n - (side-cut)*other : 1, n-1 < cut*other ? n-1 : cut*other);
+
+    for (size_t i=0; i<n; i++) {
+        Robot robot = parts->robots[ids[i]];
+        scratch[i].key = vertical ? robot->self->x : robot->self->y;
+        scratch[i].id  = ids[i];
+    }
+    qsort(scratch, n, sizeof *scratch, &compareKeys);
+    for (size_t i=0; i<n; i++) {
+        ids[i] = scratch[i].id;
+    }
+
+    Region first = rect, second = rect;
+    if (vertical) {
+        first.x1 = second.x0 = rect.x0 + (int) cut;
+    } else {
+        first.y1 = second.y0 = rect.y0 + (int) cut;
+    }
+    bisect(parts, regions, first, ids, n1, scratch);
+    bisect(parts, regions, second, ids + n1, n - n1, scratch);
+}
+
+/// partition the whole grid among the robots, handing each part to the robot
+/// {rotation} places further along so repeated sweeps give every part to another robot
+static void partition(Partitions parts, Region* regions, size_t rotation) {
+    size_t k = parts->k;
+    size_t* ids = safemalloc(k * sizeof *ids, MEM_PLANNING);
+    SortKey* scratch = safemalloc(k * sizeof *scratch, MEM_PLANNING);
+    Region* split = safemalloc(k * sizeof *split, MEM_PLANNING);
+    for (size_t i=0; i<k; i++) {
+        ids[i] = i;
+    }
+    Region grid = { 0, 0, (int) parts->b, (int) parts->l, 0 };
+    bisect(parts, split, grid, ids, k, scratch);
+    for (size_t i=0; i<k; i++) {
+        regions[(i + rotation) % k] = split[i];
+    }
+    safefree(ids);
+    safefree(scratch);
+    safefree(split);
+}
+
+/// create the partitions of a simulation
+Partitions makePartitions(Robot* robots, size_t k, size_t l, size_t b) {
+    Partitions parts = safemalloc(sizeof *parts, MEM_PLANNING);
+    parts->l      = l;
+    parts->b      = b;
+    parts->k      = k;
+    parts->robots = robots;
+    parts->list   = NULL;
+    pthread_mutex_init(&parts->lock, NULL);
+    return parts;
+}
+
+static void freePartition(Partition p) {
+    safefree(p->regions);
+    safefree(p);
+}
+
+/// free the partitions
+void freePartitions(Partitions parts) {
+    while (parts->list != NULL) {
+        Partition p = parts->list;
+        parts->list = p->next;
+        freePartition(p);
+    }
+    pthread_mutex_destroy(&parts->lock);
+    safefree(parts);
+}
+
+/// find or make the partition of a sweep
+Partition sharePartition(Partitions parts, size_t sweeps, const Region* regions) {
+    pthread_mutex_lock(&parts->lock);
+    Partition p = parts->list;
+    while (p != NULL && p->sweeps != sweeps) {
+        p = p->next;
+    }
+    if (p == NULL) {
+        p = safemalloc(sizeof *p, MEM_PLANNING);
+        p->sweeps  = sweeps;
+        p->regions = safemalloc(parts->k * sizeof *(p->regions), MEM_PLANNING);
+        p->users   = 0;
+        if (regions != NULL) {
+            memcpy(p->regions, regions, parts->k * sizeof *(p->regions));
+        } else {
+            partition(parts, p->regions, sweeps);
+        }
+        p->next     = parts->list;
+        parts->list = p;
+    }
+    p->users++;
+    pthread_mutex_unlock(&parts->lock);
+    return p;
+}
+
+/// stop using a partition
+void releasePartition(Partitions parts, Partition partition) {
+    pthread_mutex_lock(&parts->lock);
+    if (--partition->users == 0) {
+        Partition* link = &parts->list;
+        while (*link != partition) {
+            link = &(*link)->next;
+        }
+        *link = partition->next;
+        freePartition(partition);
+    }
+    pthread_mutex_unlock(&parts->lock);
+}
+
+/// count the unexplored cells of {r} on the map {known}
+static size_t countUnknown(const Region* r, const bool* known, size_t b) {
+    size_t unknown = 0;
+    for (int y=r->y0; y<r->y1; y++) {
+        for (int x=r->x0; x<r->x1; x++) {
+            unknown += !known[cellAt(x, y, b)];
+        }
+    }
+    return unknown;
+}
+
+/// create a robot's coverage
+Coverage makeCoverage(Partitions parts, size_t id, bool* known) {
+    Coverage cov = safemalloc(sizeof *cov, MEM_PLANNING);
+    cov->shared    = parts;
+    cov->id        = id;
+    cov->sweeps    = 0;
+    cov->partition = sharePartition(parts, 0, NULL);
+    cov->region    = cov->partition->regions[id];
+    recountCoverage(cov, known);
+    return cov;
+}
+
+/// free a robot's coverage
+void freeCoverage(Coverage cov) {
+    releasePartition(cov->shared, cov->partition);
+    safefree(cov);
+}
+
+/// recount the robot's region
+void recountCoverage(Coverage cov, bool* known) {
+    cov->region.unknown = countUnknown(&cov->region, known, cov->shared->b);
+}
+
+/// mark a cell as explored
+void coverageExplored(Coverage cov, bool* known, int x, int y) {
+    known[cellAt(x, y, cov->shared->b)] = true;
+    const Region* r = &cov->region;
+    if (x >= r->x0 && x < r->x1 && y >= r->y0 && y < r->y1) {
+        cov->region.unknown--;
+    }
+}
+
+static size_t area(const Region* r) {
+    return (size_t) (r->x1 - r->x0) * (size_t) (r->y1 - r->y0);
+}
+
+/// take over the part of the partition's region {donor} with about half of its unexplored cells,
+/// the donor keeps the part its robot stands in (or is closer to); a robot takes the whole region
+/// if it is its own, cannot be split, or the donor's robot is in the only part left to explore
+static void split(Coverage cov, size_t donor, bool* known) {
+    size_t b = cov->shared->b;
+    Region d = cov->partition->regions[donor];
+    d.unknown = countUnknown(&d, known, b);
+    cov->region = d;
+    if (donor == cov->id || area(&d) < 2) {
+        return;
+    }
+    bool vertical = d.x1 - d.x0 >= d.y1 - d.y0;
+    int lo = vertical ? d.x0 : d.y0, hi = vertical ? d.x1 : d.y1;
+
+    // cut after the slice in which half of the unexplored cells have been passed
+    size_t passed = 0;
+    int cut = lo + 1;
+    for (int s=lo; s<hi-1; s++) {
+        for (int t=(vertical ? d.y0 : d.x0); t<(vertical ? d.y1 : d.x1); t++) {
+            passed += vertical ? !known[cellAt(s, t, b)] : !known[cellAt(t, s, b)];
+        }
+        cut = s + 1;
+        if (2*passed >= d.unknown) {
+            break;
+        }
+    }
+
+    Region low = d, high = d;
+    if (vertical) {
+        low.x1 = high.x0 = cut;
+    } else {
+        low.y1 = high.y0 = cut;
+    }
+    Robot robot = cov->shared->robots[donor];
+    bool keeps_low = (vertical ? robot->self->x : robot->self->y) < cut;
+    Region taken = keeps_low ? high : low;
+    taken.unknown = keeps_low ? d.unknown - passed : passed;
+    if (taken.unknown > 0) {
+        cov->region = taken;
+    }
+}
+
+/// closest unexplored cell of a region, searched in growing diamonds around {from}
+static bool nearestUnknown(const Region* r, const struct pos* from, const bool* known, size_t b, struct pos* out) {
+    int px = from->x, py = from->y;
+    int dx = abs(px - r->x0) > abs(px - (r->x1-1)) ? abs(px - r->x0) : abs(px - (r->x1-1));
+    int dy = abs(py - r->y0) > abs(py - (r->y1-1)) ? abs(py - r->y0) : abs(py - (r->y1-1));
+    for (int d=0; d<=dx+dy; d++) {
+        int y_lo = py - d < r->y0 ? r->y0 : py - d;
+        int y_hi = py + d >= r->y1 ? r->y1 - 1 : py + d;
+        for (int y=y_lo; y<=y_hi; y++) {
+            int rem = d - abs(y - py);
+            int xs[2] = { px - rem, px + rem };
+            for (int i=0; i<(rem > 0 ? 2 : 1); i++) {
+                if (xs[i] >= r->x0 && xs[i] < r->x1 && !known[cellAt(xs[i], y, b)]) {
+                    out->x = (Coord) xs[i];
+                    out->y = (Coord) y;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/// give a robot whose region is explored a new one
+static void rebalance(Coverage cov, Robot robot, bool* known) {
+    // the region of the partition holding the nearest unexplored cell is shared
+    Partitions parts = cov->shared;
+    Region grid = { 0, 0, (int) parts->b, (int) parts->l, 0 };
+    struct pos unknown;
+    if (!nearestUnknown(&grid, robot->self, known, parts->b, &unknown)) {
+        // every cell was visited but no honest robot saw the target, so explore everything again
+        // with the regions handed around, in case a malicious robot kept quiet about it
+        log_info("  Robot %zu explored the grid without finding the target, starting sweep %zu\n", cov->id, cov->sweeps + 2);
+        restartCoverage(cov, known, cov->sweeps + 1);
+        return;
+    }
+    for (size_t r=0; r<parts->k; r++) {
+        const Region* region = &cov->partition->regions[r];
+        if (unknown.x >= region->x0 && unknown.x < region->x1 && unknown.y >= region->y0 && unknown.y < region->y1) {
+            split(cov, r, known);
+            return;
+        }
+    }
+}
+
+/// forget every explored cell and join another sweep
+void restartCoverage(Coverage cov, bool* known, size_t sweeps) {
+    Partitions parts = cov->shared;
+    memset(known, 0, parts->l * parts->b * sizeof *known);
+    releasePartition(parts, cov->partition);
+    cov->sweeps    = sweeps;
+    cov->partition = sharePartition(parts, sweeps, NULL);
+    cov->region    = cov->partition->regions[cov->id];
+    recountCoverage(cov, known);
+}
+
+/// next cell for a robot to explore
+Position coverageGoal(Coverage cov, Robot robot, bool* known) {
+    if (cov->region.unknown == 0) {
+        rebalance(cov, robot, known);
+    }
+    struct pos goal;
+    if (cov->region.unknown == 0 || !nearestUnknown(&cov->region, robot->self, known, cov->shared->b, &goal)) {
+        return NULL;
+    }
+    Position pos = safemalloc(sizeof *pos, MEM_PLANNING);
+    *pos = goal;
+    return pos;
+}
@@ -0,0 +1,82 @@
+#ifndef CSCI251_PROJECT3_COVERAGE_H
+#define CSCI251_PROJECT3_COVERAGE_H
+
+#include <glob.h>
+#include "robot.h"
+
+/// rectangle of cells [x0, x1) x [y0, y1) one robot is responsible for exploring
+typedef struct region {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    size_t unknown;     // cells of the region which are not explored yet
+} Region;
+
+/// split of the grid into one region per robot for one sweep over it, made by the first robot
+/// to start the sweep from the robots' positions and shared read-only by every robot in the sweep
+typedef struct partition {
+    size_t sweeps;          // sweep the partition is for, counted from 0
+    Region* regions;        // indexed by robot ID, their unknown counts are not kept
+    size_t users;           // coverages which refer to the partition
+    struct partition* next;
+} *Partition;
+
+/// partitions of the sweeps the robots of a simulation are in
+typedef struct partitions {
+    size_t l;
+    size_t b;
+    size_t k;
+    Robot* robots;          // every robot, indexed by ID
+    Partition list;
+    pthread_mutex_t lock;   // robots plan in parallel and may start a sweep at the same time
+} *Partitions;
+
+/// one robot's part of the exploration: the partition of its sweep and the region it explores, which
+/// starts as its own part of the partition; a robot which finished its region takes over half of the
+/// unexplored cells of the partition's region holding the nearest cell its own map does not know
+typedef struct coverage {
+    Partitions shared;
+    Partition partition;
+    size_t id;              // ID of the robot
+    Region region;          // region the robot explores, with its unexplored cells counted on the robot's map
+    size_t sweeps;          // number of times the whole grid was explored without finding the target
+} *Coverage;
+
+/// create the partitions of {k} robots on a {l}x{b} grid, none is made before it is shared
+Partitions makePartitions(Robot* robots, size_t k, size_t l, size_t b);
+
+/// free the partitions, every coverage using them must have been freed
+void freePartitions(Partitions parts);
+
+/// The partition of sweep {sweeps}, made from {regions} if no robot is in that sweep yet, or by
+/// recursive bisection of the grid into {k} regions of (nearly) equal size close to the robots'
+/// positions if {regions} is NULL. Every call must be matched by a call to releasePartition.
+Partition sharePartition(Partitions parts, size_t sweeps, const Region* regions);
+
+/// stop using a partition, it is freed once no robot uses it
+void releasePartition(Partitions parts, Partition partition);
+
+/// start the robot {id} on the first sweep, in its own part of the shared partition
+Coverage makeCoverage(Partitions parts, size_t id, bool* known);
+
+/// free a robot's coverage
+void freeCoverage(Coverage cov);
+
+/// recount how much of the robot's region is unexplored,
+/// after the region was changed directly (e.g. restored from a checkpoint)
+void recountCoverage(Coverage cov, bool* known);
+
+/// mark the cell ({x}, {y}) as explored, it must not have been explored before
+void coverageExplored(Coverage cov, bool* known, int x, int y);
+
+/// clear the map {known} and move the robot to sweep number {sweeps} (counted from 0),
+/// in which every region is handed to a different robot than in the first sweep
+void restartCoverage(Coverage cov, bool* known, size_t sweeps);
+
+/// find the unexplored cell of {robot}'s region closest to the robot, taking over a new region
+/// if the robot's region is done; once the whole grid is explored it is cleared for another sweep
+/// @returns the cell to explore next, or NULL if the robot has no region left to explore
+Position coverageGoal(Coverage cov, Robot robot, bool* known);
+
+#endif //CSCI251_PROJECT3_COVERAGE_H
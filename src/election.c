@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include "election.h"
+#include "spatial.h"
+#include "replanning.h"
+#include "scheduling.h"
+
+/// whether {id} names a robot which can lead: it is running and nobody found it to be malicious
+static bool eligible(Robot* robots, size_t k, size_t id) {
+    return id < k && !robots[id]->crashed && !robots[id]->suspected;
+}
+
+/// nearest ancestor of robot {i} in the election tree which the failure detector reports as running
+/// @returns NO_ROBOT if every ancestor crashed
+static size_t liveAncestor(Robot* robots, size_t i) {
+    while (i > 0) {
+        i = (i-1) / ELECTION_FANOUT;
+        if (!robots[i]->crashed) {
+            return i;
+        }
+    }
+    return NO_ROBOT;
+}
+
+/// elect the lowest eligible ID by passing it up the election tree
+ElectionStats electLeader(Robot* robots, size_t k) {
+    Network net = robots[0]->inbox->net;
+    unsigned long long messages = atomic_load(&net->messages);
+    ElectionStats stats = { NO_ROBOT, 0, 0 };
+
+    size_t* parent  = safemalloc(k * sizeof *parent, MEM_CONSENSUS);
+    size_t* best    = safemalloc(k * sizeof *best, MEM_CONSENSUS);     // lowest eligible ID heard of
+    size_t* waiting = safecalloc(k, sizeof *waiting, MEM_CONSENSUS);   // children yet to report
+    bool* reported  = safecalloc(k, sizeof *reported, MEM_CONSENSUS);
+
+    // every running robot finds the robot it reports to; robots with nobody above them
+    // report to the lowest of them, which announces the result
+    size_t head = NO_ROBOT;
+    for (size_t i=0; i<k; i++) {
+        if (robots[i]->crashed) {
+            reported[i] = true;
+            continue;
+        }
+        parent[i] = liveAncestor(robots, i);
+        if (parent[i] == NO_ROBOT && head == NO_ROBOT) {
+            head = i;
+        } else if (parent[i] == NO_ROBOT) {
+            parent[i] = head;
+        }
+        if (parent[i] != NO_ROBOT) {
+            waiting[parent[i]]++;
+        }
+        best[i] = robots[i]->malicious || eligible(robots, k, i) ? i : NO_ROBOT;
+    }
+
+    bool announced = head == NO_ROBOT;
+    while (!announced && stats.rounds < MAX_ELECTION_ROUNDS) {
+        networkNextRound(net);
+        stats.rounds++;
+
+        // robots which heard from their whole subtree pass its result on,
+        // a robot finding its parent's mailbox full tries again next round
+        for (size_t i=0; i<k; i++) {
+            if (reported[i] || (waiting[i] > 0 && !robots[i]->malicious)) {
+                continue;
+            }
+            if (parent[i] == NO_ROBOT) {
+                Message msg = { MSG_LEADER, i, 0, (int) best[i], 0 };
+                multicast(net, msg);
+                reported[i] = true;
+            } else {
+                Message msg = { MSG_CANDIDATE, i, 0, (int) best[i], 0 };
+                reported[i] = trySendMessage(robots[parent[i]]->inbox, msg);
+            }
+        }
+
+        // robots merge their children's reports, ignoring robots they know cannot lead
+        for (size_t i=0; i<k; i++) {
+            if (robots[i]->crashed) {
+                continue;
+            }
+            Message msg;
+            while (receiveMessage(robots[i]->inbox, &msg)) {
+                if (msg.type != MSG_CANDIDATE || waiting[i] == 0) {
+                    continue;
+                }
+                waiting[i]--;
+                size_t candidate = msg.x < 0 ? NO_ROBOT : (size_t) msg.x;
+                if (!robots[i]->malicious && eligible(robots, k, candidate) && candidate < best[i]) {
+                    best[i] = candidate;
+                }
+            }
+        }
+
+        // the announcement is the same for every robot, so it is read once
+        Message msg;
+        for (size_t i=0; peekMulticast(net, i, &msg); i++) {
+            if (msg.type != MSG_LEADER) {
+                continue;
+            }
+            announced = true;
+            size_t candidate = msg.x < 0 ? NO_ROBOT : (size_t) msg.x;
+            if (eligible(robots, k, candidate) && candidate < stats.leader) {
+                stats.leader = candidate;
+            }
+        }
+    }
+
+    stats.messages = atomic_load(&net->messages) - messages;
+    safefree(parent);
+    safefree(best);
+    safefree(waiting);
+    safefree(reported);
+    return stats;
+}
+
+/// multicast the leader's heartbeat
+void sendHeartbeat(Robot leader) {
+    if (!leader->crashed) {
+        Message msg = { MSG_HEARTBEAT, leader->ID, 0, 0, 0 };
+        multicast(leader->inbox->net, msg);
+    }
+}
+
+/// look for the leader's heartbeat in the round's multicasts
+bool heardHeartbeat(Network net, size_t leader) {
+    Message msg;
+    for (size_t i=0; peekMulticast(net, i, &msg); i++) {
+        if (msg.type == MSG_HEARTBEAT && msg.sender == leader) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// drop the old leader's view of the attack
+void handOverLeadership(Robot old, Robot* robots, size_t k) {
+    if (old->occupancy != NULL) {
+        freeOccupancy(old->occupancy);
+        old->occupancy = NULL;
+    }
+    if (old->schedule != NULL) {
+        freeSchedule(old->schedule);
+        old->schedule = NULL;
+    }
+    for (size_t i=0; i<k; i++) {
+        if (robots[i]->planner != NULL) {
+            freePlanner(robots[i]->planner);
+            robots[i]->planner = NULL;
+        }
+        robots[i]->n_history = 0;
+    }
+}
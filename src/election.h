@@ -0,0 +1,45 @@
+#ifndef CSCI251_PROJECT3_ELECTION_H
+#define CSCI251_PROJECT3_ELECTION_H
+
+#include <glob.h>
+#include "robot.h"
+
+/// children per robot in the election tree; a robot hears from at most this many
+/// children in one round, which fits into its mailbox
+#define ELECTION_FANOUT 4
+
+/// the election gives up if the tree has not reported after this many rounds
+#define MAX_ELECTION_ROUNDS 64
+
+/// the robots elect a new leader once they missed this many heartbeats in a row
+#define HEARTBEAT_TIMEOUT 2
+
+/// outcome of one leader election
+typedef struct election_stats {
+    size_t leader;                  // ID of the elected robot, NO_ROBOT if no robot can lead
+    int rounds;                     // message rounds used by the election
+    unsigned long long messages;    // messages delivered during the election
+} ElectionStats;
+
+/// elect the running robot with the lowest ID which is not suspected of being malicious
+/// The robots form a tree by ID, robot i reporting to robot (i-1)/ELECTION_FANOUT, and the lowest
+/// eligible ID is passed up the tree: a robot reports once it heard from all of its children.
+/// A robot whose parent crashed reports to its nearest running ancestor instead; robots without
+/// one report to the lowest of them, which multicasts the result to every robot.
+/// Takes O(log k) rounds, k-1 unicasts and one multicast, however many robots crashed.
+/// Malicious robots report themselves regardless of what their subtree reported,
+/// the robots ignore reports of robots they know to have crashed or be malicious.
+/// @returns the elected robot and the election's cost
+ElectionStats electLeader(Robot* robots, size_t k);
+
+/// the leader tells every robot it is still running, a crashed leader sends nothing
+void sendHeartbeat(Robot leader);
+
+/// check whether the leader's heartbeat was multicast during the current round
+bool heardHeartbeat(Network net, size_t leader);
+
+/// hand the attack phase over from {old} to the new leader, which rebuilds the occupancy grid
+/// and schedule from the robots' positions; the robots' searches used the old leader's grid
+void handOverLeadership(Robot old, Robot* robots, size_t k);
+
+#endif //CSCI251_PROJECT3_ELECTION_H
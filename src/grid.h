@@ -0,0 +1,40 @@
+#ifndef CSCI251_PROJECT3_GRID_H
+#define CSCI251_PROJECT3_GRID_H
+
+#include <glob.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/// width of a grid cell index, chosen with the GRID_INDEX_BITS CMake cache variable:
+/// 32 bits with 16-bit coordinates for grids up to 32767 cells a side,
+/// 64 bits with 32-bit coordinates for anything larger
+#ifndef GRID_INDEX_BITS
+#define GRID_INDEX_BITS 32
+#endif
+
+#if GRID_INDEX_BITS == 32
+typedef int16_t Coord;      // x or y coordinate on the grid, signed so a step off the edge is representable
+typedef uint32_t Cell;      // linear index y*b+x of a cell
+#define COORD_MAX INT16_MAX
+#define NO_CELL UINT32_MAX
+#elif GRID_INDEX_BITS == 64
+typedef int32_t Coord;
+typedef uint64_t Cell;
+#define COORD_MAX INT32_MAX
+#define NO_CELL UINT64_MAX
+#else
+#error "GRID_INDEX_BITS must be 32 or 64"
+#endif
+
+/// linear index of the cell ({x}, {y}) on a grid {b} cells wide
+static inline Cell cellAt(int x, int y, size_t b) {
+    return (Cell) y * (Cell) b + (Cell) x;
+}
+
+/// whether a grid of size {l}x{b} can be addressed with the compiled coordinate and index widths,
+/// leaving NO_CELL and a step off every edge free
+static inline bool gridFits(size_t l, size_t b) {
+    return l < COORD_MAX && b < COORD_MAX && l * b < (size_t) NO_CELL;
+}
+
+#endif //CSCI251_PROJECT3_GRID_H
@@ -10,14 +10,166 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "simulation.h"
+#include "checkpoint.h"
+#include "pipeline.h"
+#include "controls.h"
+#include "utils/export.h"
+#include "utils/log.h"
+#include "utils/safemalloc.h"
 
-#define PRINT_USAGE(prog) fprintf(stderr, "Usage: %s [-l -b -k -e -s]\n%s%s%s%s", prog, \
+#define PRINT_USAGE(prog) fprintf(stderr, "Usage: %s [-l -b -k -e -s -v -c -C -S -N -R -t -F] [--resume file] [--batch] [--headless]\n" \
+                "    [--export dest] [--format ppm|rgb] [--scale n] [--crash-leader round]\n%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s", prog, \
                 "  -l\theight of the simulation grid (default 10)\n", \
                 "  -b\twidth of the simulation grid (default 10)\n" \
                 "  -k\ttotal number of robots (default 4)\n", \
                 "  -e\tnumber of malicious robots (default 0)\n", \
-                "  -s\tseed value (default 1)\n")
+                "  -s\tseed value (default 1)\n", \
+                "  -v\tverbosity, 0=quiet 1=errors 2=info 3=debug (default 3)\n", \
+                "  -c\tcheckpoint file to periodically save the simulation to\n", \
+                "  -C\trounds between two checkpoints (default 100)\n", \
+                "  -S\tstalled robots swap assignments, yield or reassign (default swap)\n", \
+                "  -N\tmoves per round, 4=up/down/left/right 8=and diagonals (default 8)\n", \
+                "  -R\tround limit (default 2*l*b + 2*(l+b))\n", \
+                "  -t\trounds per second while playing, 0=as fast as possible (default 10, 0 with --batch)\n", \
+                "  -F\tmost frames drawn per second, 0=every frame (default 30)\n", \
+                "  --resume\tcontinue the simulation saved in a checkpoint file\n", \
+                "  --batch\tplay to the end without reading the keyboard\n", \
+                "  --headless\tlike --batch, without drawing to the terminal\n", \
+                "  --export\twrite every round as an image to a file, \"&fd\" or \"|command\"\n", \
+                "  --format\texported image format, ppm or raw rgb (default ppm)\n", \
+                "  --scale\tpixels per grid cell in exported images (default 8)\n", \
+                "  --crash-leader\tstop the leader for good after this round, the robots elect another\n")
+
+/// write the current round to {*exporter}, closing it if the destination went away
+static void exportRound(Exporter* exporter, Simulation sim, const bool* malicious) {
+    if (*exporter == NULL) {
+        return;
+    }
+    size_t k;
+    const struct pos* positions = robotPositions(sim, &k);
+    if (!export_frame(*exporter, positions, malicious, targetPosition(sim))) {
+        log_error("Frame export failed after %zu frames, no more frames are exported\n",
+                  exported_frames(*exporter));
+        free_exporter(*exporter);
+        *exporter = NULL;
+    }
+}
+
+/// run the simulation, paused until the user plays or steps it with the keyboard unless {batch} is set
+/// rounds are drawn by the render stage at most {frame_rate} times per second while the next ones run,
+/// or not at all if {headless} is set; every round is written to {export_dest} if it is given
+/// @returns the simulation's exit code
+/// a negative {strategy}, {neighborhood} or {max_rounds} keeps the simulation's own setting,
+/// the leader crashes once {crash_round} rounds are done unless it is negative
+int run(size_t l, size_t b, size_t k, size_t e, long s, const char* checkpoint, int interval, const char* resume,
+        int strategy, int neighborhood, int max_rounds, double tick_rate, double frame_rate, bool batch, bool headless,
+        const char* export_dest, FrameFormat format, size_t scale, int crash_round) {
+    Simulation sim;
+    if (resume != NULL) {
+        sim = loadCheckpoint(resume);
+        if (sim == NULL) {
+            return EXIT_FAILURE;
+        }
+        log_info("Resumed from %s at round %d\n", resume, simulationRound(sim));
+    } else {
+        sim = makeSimulation(l, b, k, e, s);
+    }
+    if (strategy >= 0) {
+        setStallStrategy(sim, (StallStrategy) strategy);
+    }
+    if (neighborhood >= 0) {
+        setNeighborhood(sim, (Neighborhood) neighborhood);
+    }
+    if (max_rounds >= 0) {
+        setRoundLimit(sim, max_rounds);
+    }
+    Checkpointer saver = checkpoint != NULL ? makeCheckpointer(checkpoint) : NULL;
+
+    // open the frame export, robots never change sides so who is malicious is looked up once
+    Robot const* robots = simulationRobots(sim, &k);
+    simulationSize(sim, &l, &b);
+    Exporter exporter = NULL;
+    bool* malicious = NULL;
+    if (export_dest != NULL) {
+        exporter = make_exporter(export_dest, format, scale, l, b, k);
+        if (exporter == NULL) {
+            printf("Cannot export frames to %s\n", export_dest);
+            exit(EXIT_FAILURE);
+        }
+        malicious = safemalloc(k * sizeof *malicious, MEM_DISPLAY);
+        for (size_t i = 0; i < k; i++) {
+            malicious[i] = robots[i]->malicious;
+        }
+    }
+
+    // set the initial display setup
+    Pipeline pipeline = headless ? NULL : startPipeline(k, frame_rate);
+    Controls controls = startControls(tick_rate, batch || headless, !(batch || headless));
+    char status[FRAME_STATUS_MAX];
+    int phase = simulationPhase(sim);
+    if (pipeline != NULL) {
+        controlsStatus(controls, status, sizeof status);
+        publishFrame(pipeline, sim, phase, status);
+    }
+    exportRound(&exporter, sim, malicious);
+
+    /** Begin the simulation loop **/
+    while(phase != PHASE_FINISHED) {    // each loop is a turn in the simulation
+        /* wait for a keypress or the next tick */
+        if (!awaitTick(controls)) {
+            phase = PHASE_FINISHED;
+        } else {
+            int round = simulationRound(sim);
+            stepSimulation(sim, 1);
+            phase = simulationPhase(sim);
+            if (crash_round >= 0 && simulationRound(sim) >= crash_round && phase != PHASE_FINISHED) {
+                crashRobot(sim, simulationLeader(sim));
+                crash_round = -1;
+            }
+
+            // periodically snapshot the simulation in the background
+            if (saver != NULL && simulationRound(sim) != round && simulationRound(sim) % interval == 0) {
+                saveCheckpoint(saver, sim);
+            }
+        }
+
+        // draw this turn while the next one is simulated, unless rendering is behind
+        if (pipeline != NULL) {
+            controlsStatus(controls, status, sizeof status);
+            publishFrame(pipeline, sim, phase, status);
+        }
+        exportRound(&exporter, sim, malicious);
+    }
+    stopControls(controls);
+    if (pipeline != NULL) {
+        stopPipeline(pipeline);
+    }
+    if (exporter != NULL) {
+        log_info("Exported %zu frames to %s\n", exported_frames(exporter), export_dest);
+        free_exporter(exporter);
+    }
+    safefree(malicious);
+
+    // print robot positions
+    const struct pos* positions = robotPositions(sim, &k);
+    log_info("Final positions of robots:\n");
+    for (size_t i = 0; i < k; i++) {
+        log_info("  Robot %zu is at (%d, %d)\n", i, positions[i].x, positions[i].y);
+    }
+
+    printSimulationStats(sim);
+    log_flush();
+    int code = simulationTimedOut(sim) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    /** Free all initialized variables **/
+    if (saver != NULL) {
+        freeCheckpointer(saver);
+    }
+    freeSimulation(sim);
+    return code;
+}
 
 int main(int argc, char* argv[])
 {
@@ -26,24 +178,85 @@ int main(int argc, char* argv[])
        b = width of simulation grid
        k = total number of robots
        e = number of robots that are evil
-       s = seed value for PRNG */
-    size_t l=10, b=10, k=4, e=0; long s=1;
+       s = seed value for PRNG
+       v = logging verbosity
+       c = checkpoint file, C = checkpoint interval
+       r = checkpoint file to resume from
+       S = stall strategy, N = neighborhood, R = round limit (unset: the simulation's defaults)
+       t = rounds per second while playing, F = frames drawn per second
+       batch = play to the end without reading the keyboard, headless = and without drawing
+       export = destination of exported frames, format and scale = their layout and size
+       crash = round after which the leader crashes (unset: never) */
+    size_t l=10, b=10, k=4, e=0; long s=1; int v=LOG_DEBUG;
+    char* c=NULL; int C=100; char* r=NULL; int S=-1, N=-1, R=-1;
+    double t=-1, F=30; int batch=0, headless=0;
+    char* export=NULL; FrameFormat format=FORMAT_PPM; long scale=EXPORT_SCALE; int crash=-1;
+    struct option long_options[] = {
+        {"resume", required_argument, NULL, 'r'},
+        {"batch", no_argument, &batch, 1},
+        {"headless", no_argument, &headless, 1},
+        {"export", required_argument, NULL, 'x'},
+        {"format", required_argument, NULL, 'f'},
+        {"scale", required_argument, NULL, 'p'},
+        {"crash-leader", required_argument, NULL, 'X'},
+        {NULL, 0, NULL, 0}
+    };
 
     // do argument parsing
     int opt;
-    while ((opt = getopt(argc, argv, "l:b:k:e:s:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "l:b:k:e:s:v:c:C:S:N:R:t:F:", long_options, NULL)) != -1) {
         switch(opt) {
             case 'l': l = (size_t) strtol(optarg, NULL, 10); break;
             case 'b': b = (size_t) strtol(optarg, NULL, 10); break;
             case 'k': k = (size_t) strtol(optarg, NULL, 10); break;
             case 'e': e = (size_t) strtol(optarg, NULL, 10); break;
             case 's': s = strtol(optarg, NULL, 10); break;
+            case 'v': v = (int) strtol(optarg, NULL, 10); break;
+            case 'c': c = optarg; break;
+            case 'C': C = (int) strtol(optarg, NULL, 10); break;
+            case 'r': r = optarg; break;
+            case 'x': export = optarg; break;
+            case 'f':
+                if (strcmp(optarg, "ppm") == 0)         format = FORMAT_PPM;
+                else if (strcmp(optarg, "rgb") == 0)    format = FORMAT_RGB;
+                else { PRINT_USAGE(argv[0]); exit(EXIT_FAILURE); }
+                break;
+            case 'p': scale = strtol(optarg, NULL, 10); break;
+            case 'X': crash = (int) strtol(optarg, NULL, 10); break;
+            case 'S':
+                if (strcmp(optarg, "swap") == 0)            S = STALL_SWAP;
+                else if (strcmp(optarg, "yield") == 0)      S = STALL_YIELD;
+                else if (strcmp(optarg, "reassign") == 0)   S = STALL_REASSIGN;
+                else { PRINT_USAGE(argv[0]); exit(EXIT_FAILURE); }
+                break;
+            case 'N':
+                if (strcmp(optarg, "4") == 0)       N = NEIGHBORHOOD_4;
+                else if (strcmp(optarg, "8") == 0)  N = NEIGHBORHOOD_8;
+                else { PRINT_USAGE(argv[0]); exit(EXIT_FAILURE); }
+                break;
+            case 'R': R = (int) strtol(optarg, NULL, 10); break;
+            case 't': t = strtod(optarg, NULL); break;
+            case 'F': F = strtod(optarg, NULL); break;
+            case 0: break;  // flag set by getopt_long
             default:
                 PRINT_USAGE(argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
+    if (t < 0) {
+        t = batch || headless ? 0 : 10;
+    }
+    if (C <= 0 || R == 0 || R < -1 || F < 0 || scale <= 0 || crash < -1) {
+        PRINT_USAGE(argv[0]);
+        exit(EXIT_FAILURE);
+    }
 
     // run the simulation and return it's exit code
-    return run(l, b, k, e, s);
+    log_start(v);
+    int code = run(l, b, k, e, s, c, C, r, S, N, R, t, F, batch, headless, export, format, (size_t) scale, crash);
+    log_stop();
+    if (v >= LOG_INFO) {
+        print_memory_report(stderr);
+    }
+    return code;
 }
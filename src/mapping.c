@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "mapping.h"
+#include "coverage.h"
+
+/// create a delta
+Delta makeDelta(void) {
+    Delta delta = safemalloc(sizeof *delta, MEM_ROBOTS);
+    delta->cells = NULL;
+    delta->n     = 0;
+    delta->cap   = 0;
+    delta->sweep = 0;
+    return delta;
+}
+
+/// free a delta
+void freeDelta(Delta delta) {
+    safefree(delta->cells);
+    safefree(delta);
+}
+
+/// mark a cell as known
+bool learnCell(Robot robot, int x, int y, size_t b) {
+    Cell cell = cellAt(x, y, b);
+    if (robot->explored[cell]) {
+        return false;
+    }
+    if (robot->coverage != NULL) {
+        coverageExplored(robot->coverage, robot->explored, x, y);
+    } else {
+        robot->explored[cell] = true;
+    }
+
+    // cells learned before the robot started over on its map are outdated
+    Delta delta = robot->delta;
+    size_t sweep = robot->coverage != NULL ? robot->coverage->sweeps : 0;
+    if (delta->sweep != sweep) {
+        delta->n     = 0;
+        delta->sweep = sweep;
+    }
+    if (delta->n == delta->cap) {
+        delta->cap   = delta->cap ? 2*delta->cap : 16;
+        delta->cells = saferealloc(delta->cells, delta->cap * sizeof *(delta->cells), MEM_ROBOTS);
+    }
+    delta->cells[delta->n++] = cell;
+    return true;
+}
+
+/// create a map exchange
+Exchange makeExchange(size_t k) {
+    Exchange ex = safemalloc(sizeof *ex, MEM_MESSAGING);
+    ex->k       = k;
+    ex->packets = safecalloc(k, sizeof *(ex->packets), MEM_MESSAGING);
+    ex->near    = safemalloc(k * sizeof *(ex->near), MEM_MESSAGING);
+    ex->partitions = NULL;
+    ex->stats   = (ExchangeStats) { 0, 0, 0, 0, 0 };
+    return ex;
+}
+
+/// free a map exchange
+void freeExchange(Exchange ex) {
+    for (size_t i=0; i<ex->k; i++) {
+        safefree(ex->packets[i].data);
+    }
+    safefree(ex->packets);
+    safefree(ex->near);
+    if (ex->partitions != NULL) {
+        freePartitions(ex->partitions);
+    }
+    safefree(ex);
+}
+
+static void putVarint(Packet* p, uint64_t v) {
+    if (p->size + 10 > p->cap) {
+        p->cap  = p->cap ? 2*p->cap : 64;
+        p->data = saferealloc(p->data, p->cap, MEM_MESSAGING);
+    }
+    while (v >= 0x80) {
+        p->data[p->size++] = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    p->data[p->size++] = (unsigned char) v;
+}
+
+static uint64_t getVarint(const Packet* p, size_t* pos) {
+    uint64_t v = 0;
+    for (int shift=0; *pos < p->size && shift < 64; shift+=7) {
+        unsigned char byte = p->data[(*pos)++];
+        v |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return v;
+}
+
+static int compareCells(const void* a, const void* b) {
+    Cell ca = *(const Cell*) a, cb = *(const Cell*) b;
+    return ca < cb ? -1 : (ca > cb);
+}
+
+/// encode a robot's delta as its sweep followed by (gap, length) pairs of runs of cell indices,
+/// where the gap is counted from the end of the previous run
+static void encodeDelta(Packet* p, Robot robot) {
+    Delta delta = robot->delta;
+    qsort(delta->cells, delta->n, sizeof *(delta->cells), &compareCells);
+    p->size  = 0;
+    p->runs  = 0;
+    p->cells = 0;
+    putVarint(p, delta->sweep);
+
+    size_t end = 0;     // one past the last cell of the previous run
+    for (size_t i=0; i<delta->n; ) {
+        Cell first = delta->cells[i], last = first;
+        for (i++; i<delta->n && delta->cells[i] <= last+1; i++) {
+            last = delta->cells[i];   // duplicates are folded into the run
+        }
+        putVarint(p, first - end);
+        putVarint(p, last - first + 1);
+        end = last + 1;
+        p->runs++;
+        p->cells += last - first + 1;
+    }
+    delta->n = 0;
+}
+
+/// merge a packet into {robot}'s map
+/// a robot hearing of a later sweep than its own joins it, clearing its map, since some other
+/// robot saw the whole grid without the target; packets of an earlier sweep are outdated
+/// @returns the number of cells which were new to the robot
+static size_t mergeDelta(const Packet* p, Robot robot, size_t b) {
+    size_t pos = 0;
+    size_t sweep = getVarint(p, &pos);
+    if (sweep < robot->coverage->sweeps) {
+        return 0;
+    }
+    if (sweep > robot->coverage->sweeps) {
+        restartCoverage(robot->coverage, robot->explored, sweep);
+    }
+    size_t merged = 0, end = 0;
+    while (pos < p->size) {
+        size_t first = end + getVarint(p, &pos);
+        size_t n = getVarint(p, &pos);
+        for (size_t cell=first; cell<first+n; cell++) {
+            merged += learnCell(robot, (int) (cell % b), (int) (cell / b), b);
+        }
+        end = first + n;
+    }
+    return merged;
+}
+
+/// do one round of mapping and exchanging
+void exchangeMaps(Exchange ex, Robot* robots, Spatial spatial, size_t l, size_t b) {
+    // a robot sees every cell within 1 tile, which is how far it can spot the target
+    if (ex->partitions == NULL) {
+        ex->partitions = makePartitions(robots, ex->k, l, b);
+    }
+    for (size_t i=0; i<ex->k; i++) {
+        Robot robot = robots[i];
+        if (robot->coverage == NULL) {
+            robot->coverage = makeCoverage(ex->partitions, i, robot->explored);
+        }
+        if (robot->crashed) {
+            continue;
+        }
+        for (int x = robot->self->x - 1; x <= robot->self->x + 1; x++) {
+            for (int y = robot->self->y - 1; y <= robot->self->y + 1; y++) {
+                if (x >= 0 && y >= 0 && x < (int) b && y < (int) l) {
+                    learnCell(robot, x, y, b);
+                }
+            }
+        }
+    }
+
+    // every packet is encoded before any is merged, so what a robot receives
+    // this round is only passed on in its next exchange
+    for (size_t i=0; i<ex->k; i++) {
+        Robot robot = robots[i];
+        ex->packets[i].size = 0;
+        if (robot->crashed || robot->delta->n == 0 || robot->delta->sweep != robot->coverage->sweeps) {
+            continue;
+        }
+        size_t n = spatialQuery(spatial, robot->self->x, robot->self->y, EXCHANGE_RADIUS, ex->near);
+        if (n > 1) {    // the robot itself is always found
+            encodeDelta(&ex->packets[i], robot);
+        }
+    }
+
+    // the neighborhood is symmetric, so every robot collects the packets of the robots near it
+    for (size_t i=0; i<ex->k; i++) {
+        Robot robot = robots[i];
+        if (robot->crashed) {
+            continue;
+        }
+        size_t n = spatialQuery(spatial, robot->self->x, robot->self->y, EXCHANGE_RADIUS, ex->near);
+        for (size_t j=0; j<n; j++) {
+            const Packet* p = &ex->packets[ex->near[j]];
+            if (ex->near[j] == i || p->size == 0) {
+                continue;
+            }
+            ex->stats.packets++;
+            ex->stats.runs   += p->runs;
+            ex->stats.cells  += p->cells;
+            ex->stats.bytes  += p->size;
+            ex->stats.merged += mergeDelta(p, robot, b);
+        }
+    }
+}
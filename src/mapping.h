@@ -0,0 +1,71 @@
+#ifndef CSCI251_PROJECT3_MAPPING_H
+#define CSCI251_PROJECT3_MAPPING_H
+
+#include <glob.h>
+#include "robot.h"
+#include "spatial.h"
+
+/// robots at most this many tiles apart (in either direction) exchange their maps
+#define EXCHANGE_RADIUS 4
+
+/// cells a robot learned since it last shared its map, in the order they were learned
+typedef struct delta {
+    Cell* cells;        // indexed y*b+x
+    size_t n;
+    size_t cap;
+    size_t sweep;       // sweep of the robot's region the cells were learned in
+} *Delta;
+
+/// counters of the map exchange
+typedef struct exchange_stats {
+    size_t packets;     // deltas delivered, counted once per receiving robot
+    size_t runs;        // runs of consecutive cells in the delivered deltas
+    size_t cells;       // cells in the delivered deltas
+    size_t bytes;       // encoded size of the delivered deltas
+    size_t merged;      // delivered cells which were new to their receiver
+} ExchangeStats;
+
+/// encoded delta of one robot, kept between rounds so its buffer is reused
+typedef struct packet {
+    unsigned char* data;
+    size_t size;
+    size_t cap;
+    size_t runs;
+    size_t cells;
+} Packet;
+
+/// map exchange between the robots of a simulation
+/// every robot keeps its own explored map and region of the grid; once per round each robot
+/// marks the cells around it, then sends the cells it learned since its last exchange to the
+/// robots within EXCHANGE_RADIUS, as runs of consecutive cell indices
+typedef struct exchange {
+    size_t k;
+    Packet* packets;    // indexed by robot ID
+    size_t* near;       // scratch for proximity queries
+    struct partitions* partitions;  // splits of the grid into regions, made on the first exchange
+    ExchangeStats stats;
+} *Exchange;
+
+/// create an empty delta
+Delta makeDelta(void);
+
+/// free a delta
+void freeDelta(Delta delta);
+
+/// mark the cell ({x}, {y}) in {robot}'s own map, recording it in the robot's delta and region
+/// @returns whether the cell was new to the robot
+bool learnCell(Robot robot, int x, int y, size_t b);
+
+/// create the map exchange of {k} robots
+Exchange makeExchange(size_t k);
+
+/// free a map exchange
+void freeExchange(Exchange ex);
+
+/// let every robot map the cells within 1 tile of it, then deliver what each robot learned since
+/// its last exchange to the robots near it; a robot with nobody near keeps its delta for later
+/// cells a robot receives are passed on in its own next exchange
+/// every robot's region of the grid is created on the first exchange, from one partition shared by all robots
+void exchangeMaps(Exchange ex, Robot* robots, Spatial spatial, size_t l, size_t b);
+
+#endif //CSCI251_PROJECT3_MAPPING_H
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+#include "messaging.h"
+#include "utils/safemalloc.h"
+#include "utils/log.h"
+
+/// initialize an array of {n} queue slots so that slot i is ready for sequence number i
+static Slot* makeSlots(size_t n) {
+    Slot* slots = safemalloc(n * sizeof *slots, MEM_MESSAGING);
+    for (size_t i=0; i<n; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    return slots;
+}
+
+/// create the message layer and a mailbox for every robot
+Network makeNetwork(size_t k, size_t capacity) {
+    // round the mailbox capacity up to a power of two so that indices can be masked
+    size_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+
+    Network net = safemalloc(sizeof *net, MEM_MESSAGING);
+    net->k         = k;
+    net->round     = 0;
+    net->mailboxes = safemalloc(k * sizeof *(net->mailboxes), MEM_MESSAGING);
+    for (size_t i=0; i<k; i++) {
+        Mailbox mb = &net->mailboxes[i];
+        mb->slots      = makeSlots(cap);
+        mb->mask       = cap - 1;
+        mb->tail       = 0;
+        mb->bcast_read = 0;
+        mb->net        = net;
+        atomic_init(&mb->head, 0);
+    }
+
+    // every robot may multicast a few messages per round
+    net->bcast_cap  = 2*k + 2;
+    net->broadcasts = safecalloc(net->bcast_cap, sizeof *(net->broadcasts), MEM_MESSAGING);
+    atomic_init(&net->bcast_size, 0);
+    atomic_init(&net->messages, 0);
+    atomic_init(&net->bytes, 0);
+    atomic_init(&net->multicasts, 0);
+    return net;
+}
+
+/// free the message layer
+void freeNetwork(Network net) {
+    for (size_t i=0; i<net->k; i++) {
+        safefree(net->mailboxes[i].slots);
+    }
+    safefree(net->mailboxes);
+    safefree(net->broadcasts);
+    safefree(net);
+}
+
+/// get a robot's inbox
+Mailbox networkMailbox(Network net, size_t id) {
+    return &net->mailboxes[id];
+}
+
+/// advance to the next delivery round
+void networkNextRound(Network net) {
+    net->round++;
+    atomic_store(&net->bcast_size, 0);
+    for (size_t i=0; i<net->k; i++) {
+        net->mailboxes[i].bcast_read = 0;
+    }
+}
+
+/// push a message into a robot's mailbox if there is room
+bool trySendMessage(Mailbox to, Message msg) {
+    msg.round = to->net->round;
+
+    // claim a slot
+    size_t pos = atomic_load_explicit(&to->head, memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &to->slots[pos & to->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&to->head, &pos, pos+1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos) {
+            return false;   // mailbox is full
+        } else {
+            pos = atomic_load_explicit(&to->head, memory_order_relaxed);
+        }
+    }
+
+    // write the message and publish the slot to the owner
+    slot->msg = msg;
+    atomic_store_explicit(&slot->seq, pos+1, memory_order_release);
+
+    atomic_fetch_add_explicit(&to->net->messages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&to->net->bytes, sizeof msg, memory_order_relaxed);
+    return true;
+}
+
+/// push a message into a robot's mailbox, waiting for the owner to drain it if it is full
+void sendMessage(Mailbox to, Message msg) {
+    while (!trySendMessage(to, msg)) {
+        sched_yield();
+    }
+}
+
+/// append a message to the round's multicast log
+void multicast(Network net, Message msg) {
+    msg.round = net->round;
+    size_t idx = atomic_fetch_add_explicit(&net->bcast_size, 1, memory_order_relaxed);
+    if (idx >= net->bcast_cap) {
+        printf("Multicast log overflowed! Exiting application...");
+        exit(EXIT_FAILURE);
+    }
+    Slot* slot = &net->broadcasts[idx];
+    slot->msg = msg;
+    atomic_store_explicit(&slot->seq, (size_t) net->round + 1, memory_order_release);
+
+    // a multicast is delivered once to every robot but the sender
+    atomic_fetch_add_explicit(&net->multicasts, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&net->messages, net->k - 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&net->bytes, (net->k - 1) * sizeof msg, memory_order_relaxed);
+}
+
+/// pop the next message of the current round
+bool receiveMessage(Mailbox mb, Message* out) {
+    for (;;) {
+        Slot* slot = &mb->slots[mb->tail & mb->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != mb->tail + 1) {
+            return false;   // mailbox is empty
+        }
+        if (slot->msg.round > mb->net->round) {
+            return false;   // message belongs to a later round
+        }
+
+        // consume the slot and hand it back to the producers
+        Message msg = slot->msg;
+        atomic_store_explicit(&slot->seq, mb->tail + mb->mask + 1, memory_order_release);
+        mb->tail++;
+
+        // messages left over from earlier rounds are stale
+        if (msg.round == mb->net->round) {
+            *out = msg;
+            return true;
+        }
+    }
+}
+
+/// wait for the next message of the current round
+Message awaitMessage(Mailbox mb) {
+    Message msg;
+    while (!receiveMessage(mb, &msg)) {
+        sched_yield();
+    }
+    return msg;
+}
+
+/// read the next unseen multicast of the current round
+bool receiveMulticast(Mailbox mb, Message* out) {
+    Network net = mb->net;
+    size_t self = (size_t) (mb - net->mailboxes);
+    size_t size = atomic_load_explicit(&net->bcast_size, memory_order_acquire);
+    if (size > net->bcast_cap) {
+        size = net->bcast_cap;
+    }
+    while (mb->bcast_read < size) {
+        Slot* slot = &net->broadcasts[mb->bcast_read];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != (size_t) net->round + 1) {
+            return false;   // the sender has not finished writing this entry
+        }
+        mb->bcast_read++;
+        if (slot->msg.sender != self) { // robots do not receive their own multicasts
+            *out = slot->msg;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// read a multicast of the current round for all receivers
+bool peekMulticast(Network net, size_t index, Message* out) {
+    if (index >= atomic_load_explicit(&net->bcast_size, memory_order_acquire) || index >= net->bcast_cap) {
+        return false;
+    }
+    Slot* slot = &net->broadcasts[index];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != (size_t) net->round + 1) {
+        return false;
+    }
+    *out = slot->msg;
+    return true;
+}
+
+/// print the network's message counters
+void printNetworkStats(Network net) {
+    log_info("Messages delivered: %llu (%llu bytes), multicasts: %llu\n",
+           atomic_load(&net->messages), atomic_load(&net->bytes), atomic_load(&net->multicasts));
+}
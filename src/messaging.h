@@ -0,0 +1,104 @@
+#ifndef CSCI251_PROJECT3_MESSAGING_H
+#define CSCI251_PROJECT3_MESSAGING_H
+
+#include <glob.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/// kinds of messages exchanged between robots
+typedef enum msg_type {
+    MSG_MOVE,       // leader orders a robot to move to a position
+    MSG_TARGET,     // a robot announces the target's position
+    MSG_ECHO,       // a robot echoes the target announcement it received
+    MSG_READY,      // a robot is ready to accept a target position
+    MSG_CANDIDATE,  // a robot reports the lowest eligible ID of its subtree to its parent (ID in x)
+    MSG_LEADER,     // a robot at the top of the election tree announces the winner (ID in x)
+    MSG_HEARTBEAT   // the leader tells every robot it is still running
+} MsgType;
+
+/// a single fixed-size message
+typedef struct message {
+    MsgType type;
+    size_t sender;      // ID of the sending robot
+    int round;          // network round in which the message was sent
+    int x;              // position carried by the message
+    int y;
+} Message;
+
+/// one slot of a bounded lock-free queue
+typedef struct slot {
+    atomic_size_t seq;  // sequence number used to hand the slot between producers and consumer
+    Message msg;
+} Slot;
+
+/// bounded lock-free multi-producer/single-consumer queue,
+/// every robot owns one and is the only one to read from it
+typedef struct mailbox {
+    Slot* slots;
+    size_t mask;                // capacity-1, capacity is a power of two
+    atomic_size_t head;         // next slot a producer will claim
+    size_t tail;                // next slot the owner will read
+    size_t bcast_read;          // owner's read cursor into the network's multicast log
+    struct network* net;
+} *Mailbox;
+
+/// the message layer shared by all robots of a simulation
+typedef struct network {
+    size_t k;                   // number of mailboxes
+    struct mailbox* mailboxes;  // one inbox per robot, indexed by robot ID
+    Slot* broadcasts;           // batched multicast log for the current round
+    size_t bcast_cap;
+    atomic_size_t bcast_size;
+    int round;                  // current delivery round
+    atomic_ullong messages;     // total messages delivered (a multicast counts once per receiver)
+    atomic_ullong bytes;        // total payload bytes delivered
+    atomic_ullong multicasts;   // total number of batched multicasts sent
+} *Network;
+
+/// create the message layer for {k} robots with {capacity} messages per mailbox
+/// capacity is rounded up to the next power of two
+Network makeNetwork(size_t k, size_t capacity);
+
+/// free the message layer and every mailbox it owns
+void freeNetwork(Network net);
+
+/// get the inbox of the robot with ID {id}
+Mailbox networkMailbox(Network net, size_t id);
+
+/// move every mailbox into the next delivery round,
+/// messages which were not consumed during the previous round are dropped
+/// must not be called while robots are still consuming messages
+void networkNextRound(Network net);
+
+/// send {msg} to the robot owning {to}, stamping it with the current round
+/// safe to call from several threads at once; blocks while the mailbox is full
+void sendMessage(Mailbox to, Message msg);
+
+/// send {msg} to the robot owning {to} unless its mailbox is full
+/// @returns false if the message was not sent
+bool trySendMessage(Mailbox to, Message msg);
+
+/// send {msg} to every robot with one append to the round's multicast log
+/// safe to call from several threads at once
+void multicast(Network net, Message msg);
+
+/// pop the next message sent to {mb} during the current round
+/// @returns false if no message for the current round is available (yet)
+bool receiveMessage(Mailbox mb, Message* out);
+
+/// block until a message for the current round arrives in {mb}
+Message awaitMessage(Mailbox mb);
+
+/// read the next multicast of the current round that the owner of {mb} has not seen
+/// @returns false if the owner has read every multicast published so far
+bool receiveMulticast(Mailbox mb, Message* out);
+
+/// read the {index}-th multicast of the current round on behalf of every receiver at once
+/// used to aggregate a round's multicasts a single time instead of once per robot
+/// @returns false if the entry has not been published (yet)
+bool peekMulticast(Network net, size_t index, Message* out);
+
+/// print the network's message counters
+void printNetworkStats(Network net);
+
+#endif //CSCI251_PROJECT3_MESSAGING_H
@@ -1,236 +1,526 @@
 #include "robot.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <limits.h>
 #include "pathfinding.h"
 
-/// finds next batch of neighbors
-void find_neighbors(Position** neighbors, Position** visited, size_t* s_neighbors, size_t* s_visited, size_t l, size_t b) {
-    /* add neighbors to visited nodes */
-    *s_visited += *s_neighbors;
-    *visited = realloc(*visited, (*s_visited) * (sizeof **visited));
-    for (size_t j=0; j<*s_neighbors; j++) {
-        (*visited)[j+(*s_visited)-(*s_neighbors)] = (*neighbors)[j];
-    }
-
-    /* generate next depth-level's neighbors */
-    size_t counter = 0;
-    Position* new_neighbors = safemalloc((sizeof *new_neighbors)*(*s_neighbors)*4);
-    for (size_t j=0; j<*s_neighbors; j++) { // for each node in current neighbors list
-        // loop through visited nodes and determine if candidate
-        // neighbors have been visited already
-        bool up=true, down=true, right=true, left=true;
-        for (size_t e=0; e<*s_visited; e++) {
-            if ((*visited)[e]->x == (*neighbors)[j]->x &&
-                    (*visited)[e]->y == (*neighbors)[j]->y+1) {
-                up = false;
-            }
-            if ((*visited)[e]->x == (*neighbors)[j]->x &&
-                    (*visited)[e]->y == (*neighbors)[j]->y-1) {
-                down = false;
-            }
-            if ((*visited)[e]->x == (*neighbors)[j]->x+1 &&
-                    (*visited)[e]->y == (*neighbors)[j]->y) {
-                right = false;
-            }
-            if ((*visited)[e]->x == (*neighbors)[j]->x-1 &&
-                    (*visited)[e]->y == (*neighbors)[j]->y) {
-                left = false;
-            }
-        }
-        // loop through new_neighbors to verify that a position is not
-        // created and added to the neighbors list twice
-        for (size_t e=0; e<counter; e++) {
-            if ((new_neighbors)[e]->x == (*neighbors)[j]->x &&
-                (new_neighbors)[e]->y == (*neighbors)[j]->y+1) {
-                up = false;
-            }
-            if ((new_neighbors)[e]->x == (*neighbors)[j]->x &&
-                (new_neighbors)[e]->y == (*neighbors)[j]->y-1) {
-                down = false;
-            }
-            if ((new_neighbors)[e]->x == (*neighbors)[j]->x+1 &&
-                (new_neighbors)[e]->y == (*neighbors)[j]->y) {
-                right = false;
-            }
-            if ((new_neighbors)[e]->x == (*neighbors)[j]->x-1 &&
-                (new_neighbors)[e]->y == (*neighbors)[j]->y) {
-                left = false;
+static void dropIdleSearches(Landmarks lm);
+
+static bool isFree(const unsigned char* blocked, Cell cell) {
+    return blocked == NULL || !blocked[cell];
+}
+
+/// list the moves out of a cell
+int gridMoves(const unsigned char* blocked, size_t l, size_t b, Neighborhood moves, Cell cell, Cell out[8]) {
+    Cell x = cell % b, y = cell / b;
+    bool up    = y+1 < l && isFree(blocked, cell + b);
+    bool down  = y > 0   && isFree(blocked, cell - b);
+    bool right = x+1 < b && isFree(blocked, cell + 1);
+    bool left  = x > 0   && isFree(blocked, cell - 1);
+    int n = 0;
+    if (moves == NEIGHBORHOOD_8) {
+        if (up && right && isFree(blocked, cell + b + 1))   { out[n++] = cell + b + 1; }
+        if (up && left && isFree(blocked, cell + b - 1))    { out[n++] = cell + b - 1; }
+        if (down && right && isFree(blocked, cell - b + 1)) { out[n++] = cell - b + 1; }
+        if (down && left && isFree(blocked, cell - b - 1))  { out[n++] = cell - b - 1; }
+    }
+    if (up)    { out[n++] = cell + b; }
+    if (down)  { out[n++] = cell - b; }
+    if (right) { out[n++] = cell + 1; }
+    if (left)  { out[n++] = cell - 1; }
+    return n;
+}
+
+/// fewest moves between two cells on an empty grid
+size_t gridDistance(Neighborhood moves, int x0, int y0, int x1, int y1) {
+    size_t dx = (size_t) labs((long) x0 - x1), dy = (size_t) labs((long) y0 - y1);
+    if (moves == NEIGHBORHOOD_8) {
+        return dx > dy ? dx : dy;
+    }
+    return dx + dy;
+}
+
+/// breadth-first search outwards from {goal} over the free cells, {dist} must be UNREACHABLE everywhere
+/// every move can be made both ways, so searching from the goal finds the distances to it
+/// @returns the number of cells reached, which are left in {queue} in order of their distance
+static size_t spreadDistances(const unsigned char* blocked, size_t l, size_t b, Neighborhood moves, Cell goal,
+                              int* dist, Cell* queue) {
+    size_t head = 0, tail = 0;
+    dist[goal] = 0;
+    queue[tail++] = goal;
+    while (head < tail) {
+        Cell cell = queue[head++];
+        Cell nbrs[8];
+        int n = gridMoves(blocked, l, b, moves, cell, nbrs);
+        for (int i=0; i<n; i++) {
+            if (dist[nbrs[i]] == UNREACHABLE) {
+                dist[nbrs[i]] = dist[cell] + 1;
+                queue[tail++] = nbrs[i];
             }
         }
+    }
+    return tail;
+}
 
-        // if candidate neighbor has not been visited and is within bounds,
-        // add the candidate to the new_neighbors list
-        if ((*neighbors)[j]->y < l-1 && up) {    // up
-            new_neighbors[counter] = safemalloc(sizeof **new_neighbors);
-            new_neighbors[counter]->x = (*neighbors)[j]->x;
-            new_neighbors[counter]->y = (*neighbors)[j]->y+1;
-            counter++;
-        }
-        if ((*neighbors)[j]->y > 0 && down) {  // down
-            new_neighbors[counter] = safemalloc(sizeof **new_neighbors);
-            new_neighbors[counter]->x = (*neighbors)[j]->x;
-            new_neighbors[counter]->y = (*neighbors)[j]->y-1;
-            counter++;
-        }
-        if ((*neighbors)[j]->x < b-1 && right) {   // right
-            new_neighbors[counter] = safemalloc(sizeof **new_neighbors);
-            new_neighbors[counter]->x = (*neighbors)[j]->x+1;
-            new_neighbors[counter]->y = (*neighbors)[j]->y;
-            counter++;
-        }
-        if ((*neighbors)[j]->x > 0 && left) {    // left
-            new_neighbors[counter] = safemalloc(sizeof **new_neighbors);
-            new_neighbors[counter]->x = (*neighbors)[j]->x-1;
-            new_neighbors[counter]->y = (*neighbors)[j]->y;
-            counter++;
+/// create a distance field
+DistanceField makeDistanceField(size_t l, size_t b, Neighborhood moves) {
+    DistanceField field = safemalloc(sizeof *field, MEM_PATHFINDING);
+    field->l       = l;
+    field->b       = b;
+    field->moves   = moves;
+    field->blocked = safemalloc(l*b * sizeof *(field->blocked), MEM_PATHFINDING);
+    field->dist    = safemalloc(l*b * sizeof *(field->dist), MEM_PATHFINDING);
+    field->queue   = safemalloc(l*b * sizeof *(field->queue), MEM_PATHFINDING);
+    field->goal    = NO_CELL;
+    return field;
+}
+
+/// free a distance field
+void freeDistanceField(DistanceField field) {
+    safefree(field->blocked);
+    safefree(field->dist);
+    safefree(field->queue);
+    safefree(field);
+}
+
+/// breadth-first search outwards from the goal
+void computeDistances(DistanceField field, Position* objects, size_t o_size, const struct pos* goal) {
+    size_t l = field->l, b = field->b;
+    memset(field->blocked, 0, l*b * sizeof *(field->blocked));
+    for (size_t j=0; j<o_size; j++) {
+        if (objects[j]->x >= 0 && objects[j]->y >= 0 && (size_t) objects[j]->x < b && (size_t) objects[j]->y < l) {
+            field->blocked[cellAt(objects[j]->x, objects[j]->y, b)] = 1;
         }
     }
+    for (size_t i=0; i<l*b; i++) {
+        field->dist[i] = UNREACHABLE;
+    }
+
+    // a goal off the grid or under an object cannot be reached from anywhere
+    field->goal = NO_CELL;
+    if (goal->x < 0 || goal->y < 0 || (size_t) goal->x >= b || (size_t) goal->y >= l) {
+        return;
+    }
+    field->goal = cellAt(goal->x, goal->y, b);
+    if (field->blocked[field->goal]) {
+        return;
+    }
 
-    /* free old neighbors list and shrink new_neighbors to true size */
-    free(*neighbors);
-    *neighbors = realloc(new_neighbors, (sizeof **neighbors)*counter);
-    *s_neighbors = counter;
+    spreadDistances(field->blocked, l, b, field->moves, field->goal, field->dist, field->queue);
 }
 
-/// Cleanup Position neighbors and visited nodes' allocated memory
-void free_nodes(Position* neighbors, Position* visited, size_t s_neighbors, size_t s_visited) {
-    for (size_t i=0; i<s_neighbors; i++) {
-        free(neighbors[i]);
+/// path length from a source which may itself be taken
+size_t fieldDistance(DistanceField field, const struct pos* source) {
+    Cell cell = cellAt(source->x, source->y, field->b);
+    if (cell == field->goal) {
+        return 1;
     }
-    free(neighbors);
-    for (size_t i=0; i<s_visited; i++) {
-        free(visited[i]);
+    Cell nbrs[8];
+    size_t best = 0;
+    int n = gridMoves(field->blocked, field->l, field->b, field->moves, cell, nbrs);
+    for (int i=0; i<n; i++) {
+        int d = field->dist[nbrs[i]];
+        if (d != UNREACHABLE && (best == 0 || (size_t) d + 1 < best)) {
+            best = (size_t) d + 1;
+        }
     }
-    free(visited);
+    return best;
 }
 
-/// Finds the size of the shortest path
-size_t find_path(Position* objects, size_t o_size, Position target, Position source, size_t l, size_t b) {
+/// step onto the move closest to the goal
+struct pos fieldNextStep(DistanceField field, const struct pos* current) {
+    struct pos next = *current;
+    Cell cell = cellAt(current->x, current->y, field->b);
+    Cell nbrs[8];
+    size_t top_value = SIZE_MAX;
+    int n = gridMoves(field->blocked, field->l, field->b, field->moves, cell, nbrs);
+    for (int i=0; i<n; i++) {
+        // moving onto the goal counts as a path of length 1, like moving next to it
+        size_t value = nbrs[i] == field->goal ? 1
+                     : field->dist[nbrs[i]] == UNREACHABLE ? 0 : (size_t) field->dist[nbrs[i]];
+        if (value != 0 && value < top_value) {
+            top_value = value;
+            next.x = (Coord) (nbrs[i] % field->b);
+            next.y = (Coord) (nbrs[i] / field->b);
+        }
+    }
+    return next;
+}
 
-    /* if target == source, return depth 1 */
-    if (target->x == source->x && target->y == source->y) {
-        return 1;
+/** Landmarks **/
+
+/// create landmarks for a {l}x{b} grid, placed by the first call to placeLandmarks
+Landmarks makeLandmarks(size_t l, size_t b) {
+    Landmarks lm = safemalloc(sizeof *lm, MEM_PATHFINDING);
+    lm->l       = l;
+    lm->b       = b;
+    lm->moves   = 0;
+    lm->walls   = safecalloc(l*b, sizeof *(lm->walls), MEM_PATHFINDING);
+    lm->n_walls = 0;
+    lm->n       = 0;
+    lm->dist    = safemalloc(ALT_LANDMARKS * l*b * sizeof *(lm->dist), MEM_PATHFINDING);
+    atomic_init(&lm->queries, 0);
+    atomic_init(&lm->expanded, 0);
+    lm->idle    = NULL;
+    pthread_mutex_init(&lm->idle_lock, NULL);
+    return lm;
+}
+
+/// free landmarks
+void freeLandmarks(Landmarks lm) {
+    dropIdleSearches(lm);
+    pthread_mutex_destroy(&lm->idle_lock);
+    safefree(lm->walls);
+    safefree(lm->dist);
+    safefree(lm);
+}
+
+/// pick landmarks far apart from each other and search outwards from every one of them
+void placeLandmarks(Landmarks lm, Neighborhood moves, Position* walls, size_t n_walls) {
+    size_t l = lm->l, b = lm->b, cells = l*b;
+    dropIdleSearches(lm);       // their copies of the walls are outdated
+    lm->moves   = moves;
+    lm->n_walls = n_walls;
+    lm->n       = 0;
+    memset(lm->walls, 0, cells * sizeof *(lm->walls));
+    for (size_t j=0; j<n_walls; j++) {
+        lm->walls[cellAt(walls[j]->x, walls[j]->y, b)] = 1;
     }
+    Cell* queue = safemalloc(cells * sizeof *queue, MEM_PATHFINDING);
 
-    /* find neighbors for 1st level depth */
-    Position* neighbors = safemalloc(sizeof *neighbors);    // neighboring nodes
-    neighbors[0]        = safemalloc(sizeof **neighbors);
-    neighbors[0]->x = source->x; neighbors[0]->y = source->y;
-    size_t s_neighbors  = 1;    // size of neighbors
-
-    /* fill list of visited nodes with object positions */
-    Position* visited = safemalloc((sizeof *neighbors)*o_size); // visited nodes
-    size_t s_visited  = o_size;                             // size of visited
-    for(size_t j=0; j<o_size; j++) {            // copy objects into visited
-        Position pos = safemalloc(sizeof *pos);
-        pos->x = objects[j]->x;
-        pos->y = objects[j]->y;
-        visited[j] = pos;
-    }
-    find_neighbors(&neighbors, &visited, &s_neighbors, &s_visited, l, b);
-
-    /* execute depth-first search for the target position */
-    size_t depth = 1;
-    while (s_neighbors > 0) {
-        for (size_t i=0; i<s_neighbors; i++) {
-            if(target->x == neighbors[i]->x
-               && target->y == neighbors[i]->y) {
-                free_nodes(neighbors, visited, s_neighbors, s_visited);
-                return depth;
+    // the first landmark is the cell farthest from the first free cell, which is a corner of an open grid
+    Cell start = 0;
+    while (start < cells && lm->walls[start]) {
+        start++;
+    }
+    Cell next = NO_CELL;
+    if (start < cells) {
+        for (size_t i=0; i<cells; i++) {
+            lm->dist[i] = UNREACHABLE;
+        }
+        size_t reached = spreadDistances(lm->walls, l, b, moves, start, lm->dist, queue);
+        next = queue[reached-1];
+    }
+
+    // every further landmark is the cell farthest from the landmarks placed so far
+    while (next != NO_CELL && lm->n < ALT_LANDMARKS) {
+        int* dist = &lm->dist[lm->n * cells];
+        for (size_t i=0; i<cells; i++) {
+            dist[i] = UNREACHABLE;
+        }
+        spreadDistances(lm->walls, l, b, moves, next, dist, queue);
+        lm->cells[lm->n++] = next;
+
+        next = NO_CELL;
+        int farthest = 0;
+        for (Cell i=0; i<cells; i++) {
+            int closest = INT_MAX;
+            for (size_t j=0; j<lm->n && closest>0; j++) {
+                int d = lm->dist[j*cells + i];
+                if (d != UNREACHABLE && d < closest) {
+                    closest = d;
+                }
+            }
+            if (closest != INT_MAX && closest > farthest) {
+                farthest = closest;
+                next = i;
             }
         }
-        find_neighbors(&neighbors, &visited, &s_neighbors, &s_visited, l, b);
-        depth++;
     }
-    free_nodes(neighbors, visited, s_neighbors, s_visited);
-    return NULL;    // target could not be reached
+    safefree(queue);
 }
 
-/// Find the first node of the shortest path
-/// Uses find_path() to determine the size of the shortest path for
-///   all possible branches (max 4) from the current position
-Position shortest_path(Position* objects, size_t o_size, Position current, Position target, size_t l, size_t b) {
+/** A* search **/
 
-    /* create starting candidate as current position */
-    Position candidate = safemalloc(sizeof *candidate);
-    candidate->x = current->x; candidate->y = current->y;
-    size_t top_value = SIZE_MAX;
+/// a cell waiting to be expanded
+typedef struct open_entry {
+    size_t f;       // length of the path through the cell, bounded from below
+    Cell g;         // length of the path to the cell
+    Cell cell;
+} OpenEntry;
 
-    /* do not try branches which are blocked by an object */
-    bool take_up=true, take_down=true, take_right=true, take_left=true;
-    for (size_t e=0; e<o_size; e++) {
-        if (objects[e]->x == current->x &&
-            objects[e]->y == current->y+1) {
-            take_up = false;
+struct path_search {
+    Landmarks lm;
+    unsigned char* blocked;     // walls and the obstacles of the queries, indexed y*b+x
+    Cell* obstacles;            // cells the obstacles were placed on, to free them again
+    size_t n_obstacles;
+    size_t cap_obstacles;
+
+    unsigned* reached;          // query which last reached a cell, the g values of other cells are stale
+    Cell* g;
+    unsigned query;
+    unsigned exhausted;         // query which reached every cell it could without finding the goal
+    Cell exhausted_goal;
+
+    Cell goal;
+    int goal_dist[ALT_LANDMARKS];
+
+    OpenEntry* heap;
+    size_t heap_size;
+    size_t heap_cap;
+
+    unsigned long long queries;
+    unsigned long long expanded;
+    PathSearch next;            // next idle search of the landmarks
+};
+
+/// create a search on the grid of {lm}, or take one freed earlier
+PathSearch makePathSearch(Landmarks lm) {
+    pthread_mutex_lock(&lm->idle_lock);
+    PathSearch search = lm->idle;
+    if (search != NULL) {
+        lm->idle = search->next;
+    }
+    pthread_mutex_unlock(&lm->idle_lock);
+    if (search != NULL) {
+        return search;
+    }
+
+    size_t cells = lm->l * lm->b;
+    search = safemalloc(sizeof *search, MEM_PATHFINDING);
+    search->lm            = lm;
+    search->blocked       = safemalloc(cells * sizeof *(search->blocked), MEM_PATHFINDING);
+    memcpy(search->blocked, lm->walls, cells * sizeof *(search->blocked));
+    search->cap_obstacles = 16;
+    search->n_obstacles   = 0;
+    search->obstacles     = safemalloc(search->cap_obstacles * sizeof *(search->obstacles), MEM_PATHFINDING);
+    search->reached       = safecalloc(cells, sizeof *(search->reached), MEM_PATHFINDING);
+    search->g             = safemalloc(cells * sizeof *(search->g), MEM_PATHFINDING);
+    search->query         = 0;
+    search->exhausted     = 0;
+    search->heap_cap      = 64;
+    search->heap_size     = 0;
+    search->heap          = safemalloc(search->heap_cap * sizeof *(search->heap), MEM_PATHFINDING);
+    search->queries       = 0;
+    search->expanded      = 0;
+    search->next          = NULL;
+    return search;
+}
+
+/// add a search's counters to the landmarks' and hand it back to them without its obstacles;
+/// the stamps of its cells stay valid, so the next query does not clear the grid
+void freePathSearch(PathSearch search) {
+    Landmarks lm = search->lm;
+    atomic_fetch_add(&lm->queries, search->queries);
+    atomic_fetch_add(&lm->expanded, search->expanded);
+    search->queries  = 0;
+    search->expanded = 0;
+    setPathObstacles(search, NULL, 0);
+    pthread_mutex_lock(&lm->idle_lock);
+    search->next = lm->idle;
+    lm->idle     = search;
+    pthread_mutex_unlock(&lm->idle_lock);
+}
+
+/// free the searches the landmarks kept
+static void dropIdleSearches(Landmarks lm) {
+    while (lm->idle != NULL) {
+        PathSearch search = lm->idle;
+        lm->idle = search->next;
+        safefree(search->blocked);
+        safefree(search->obstacles);
+        safefree(search->reached);
+        safefree(search->g);
+        safefree(search->heap);
+        safefree(search);
+    }
+}
+
+/// replace the obstacles of the previous queries
+void setPathObstacles(PathSearch search, Position* objects, size_t o_size) {
+    Landmarks lm = search->lm;
+    for (size_t j=0; j<search->n_obstacles; j++) {
+        search->blocked[search->obstacles[j]] = lm->walls[search->obstacles[j]];
+    }
+    search->n_obstacles = 0;
+    for (size_t j=0; j<o_size; j++) {
+        if (objects[j]->x < 0 || objects[j]->y < 0 || (size_t) objects[j]->x >= lm->b || (size_t) objects[j]->y >= lm->l) {
+            continue;
         }
-        if (objects[e]->x == current->x &&
-            objects[e]->y == current->y-1) {
-            take_down = false;
+        if (search->n_obstacles == search->cap_obstacles) {
+            search->cap_obstacles *= 2;
+            search->obstacles = saferealloc(search->obstacles, search->cap_obstacles * sizeof *(search->obstacles),
+                                            MEM_PATHFINDING);
         }
-        if (objects[e]->x == current->x+1 &&
-            objects[e]->y == current->y) {
-            take_right = false;
+        Cell cell = cellAt(objects[j]->x, objects[j]->y, lm->b);
+        search->blocked[cell] = 1;
+        search->obstacles[search->n_obstacles++] = cell;
+    }
+    search->exhausted = 0;
+}
+
+/// lower bound on the moves from {cell} to the goal of the current query
+static size_t lowerBound(PathSearch search, Cell cell) {
+    Landmarks lm = search->lm;
+    size_t b = lm->b, cells = lm->l * b;
+    size_t bound = gridDistance(lm->moves, (int) (cell % b), (int) (cell / b),
+                                (int) (search->goal % b), (int) (search->goal / b));
+    for (size_t i=0; i<lm->n; i++) {
+        int d = lm->dist[i*cells + cell];
+        if (d == UNREACHABLE || search->goal_dist[i] == UNREACHABLE) {
+            continue;
         }
-        if (objects[e]->x == current->x-1 &&
-            objects[e]->y == current->y) {
-            take_left = false;
+        size_t diff = (size_t) abs(d - search->goal_dist[i]);
+        if (diff > bound) {
+            bound = diff;
         }
     }
+    return bound;
+}
 
-    /* find path size for upwards branch */
-    if(current->y < l-1 && take_up) {
-        Position up = safemalloc(sizeof *up);
-        up->x = current->x; up->y = current->y+1;
-        size_t up_value = find_path(objects, o_size, target, up, l, b);
-        if (up_value < top_value && up_value!=NULL) {
-            free(candidate);
-            candidate = up;
-            top_value = up_value;
-        } else {
-            free(up);
-        }
+/// whether {a} is expanded before {b}: shorter bounds first, then the entry deeper into the search
+static bool openBefore(const OpenEntry* a, const OpenEntry* b) {
+    return a->f < b->f || (a->f == b->f && a->g > b->g);
+}
+
+static void pushOpen(PathSearch search, OpenEntry entry) {
+    if (search->heap_size == search->heap_cap) {
+        search->heap_cap *= 2;
+        search->heap = saferealloc(search->heap, search->heap_cap * sizeof *(search->heap), MEM_PATHFINDING);
     }
+    size_t i = search->heap_size++;
+    while (i > 0 && openBefore(&entry, &search->heap[(i-1)/2])) {
+        search->heap[i] = search->heap[(i-1)/2];
+        i = (i-1)/2;
+    }
+    search->heap[i] = entry;
+}
 
-    /* find path size for downwards branch */
-    if(current->y > 0 && take_down) {
-        Position down = safemalloc(sizeof *down);
-        down->x = current->x; down->y = current->y-1;
-        size_t down_value = find_path(objects, o_size, target, down, l, b);
-        if (down_value < top_value && down_value!=NULL) {
-            free(candidate);
-            candidate = down;
-            top_value = down_value;
-        } else {
-            free(down);
+static OpenEntry popOpen(PathSearch search) {
+    OpenEntry top = search->heap[0];
+    OpenEntry last = search->heap[--search->heap_size];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2*i + 1;
+        if (child >= search->heap_size) {
+            break;
+        }
+        if (child+1 < search->heap_size && openBefore(&search->heap[child+1], &search->heap[child])) {
+            child++;
         }
+        if (!openBefore(&search->heap[child], &last)) {
+            break;
+        }
+        search->heap[i] = search->heap[child];
+        i = child;
+    }
+    if (search->heap_size > 0) {
+        search->heap[i] = last;
     }
+    return top;
+}
 
-    /* find path size for rightwards branch */
-    if(current->x < b-1 && take_right) {
-        Position right = safemalloc(sizeof *right);
-        right->x = current->x+1; right->y = current->y;
-        size_t right_value = find_path(objects, o_size, target, right, l, b);
-        if (right_value < top_value && right_value!=NULL) {
-            free(candidate);
-            candidate = right;
-            top_value = right_value;
-        } else {
-            free(right);
+/// A* from the source towards the goal, giving up on paths of {limit} moves or more
+size_t pathLength(PathSearch search, const struct pos* source, const struct pos* goal, size_t limit) {
+    Landmarks lm = search->lm;
+    size_t l = lm->l, b = lm->b;
+    if (goal->x < 0 || goal->y < 0 || (size_t) goal->x >= b || (size_t) goal->y >= l) {
+        return 0;
+    }
+    Cell start = cellAt(source->x, source->y, b);
+    search->goal = cellAt(goal->x, goal->y, b);
+    if (start == search->goal) {
+        return limit > 1 ? 1 : 0;
+    }
+
+    // the goal cannot be reached from anywhere the last exhaustive search towards it got to
+    if (search->blocked[search->goal]
+            || (search->exhausted != 0 && search->exhausted_goal == search->goal
+                && search->reached[start] == search->exhausted)) {
+        return 0;
+    }
+    for (size_t i=0; i<lm->n; i++) {
+        search->goal_dist[i] = lm->dist[i*l*b + search->goal];
+    }
+    size_t bound = lowerBound(search, start);
+    if (bound >= limit) {
+        return 0;
+    }
+
+    if (++search->query == 0) {     // the stamps wrapped around, forget every earlier query
+        memset(search->reached, 0, l*b * sizeof *(search->reached));
+        search->exhausted = 0;
+        search->query = 1;
+    }
+    search->queries++;
+    search->heap_size = 0;
+    search->reached[start] = search->query;
+    search->g[start] = 0;
+    pushOpen(search, (OpenEntry) { bound, 0, start });
+
+    // the bounds are consistent, so a cell's path is shortest once it leaves the heap
+    bool pruned = false;
+    while (search->heap_size > 0) {
+        OpenEntry entry = popOpen(search);
+        if (entry.g > search->g[entry.cell]) {
+            continue;   // the cell was reached on a shorter path since
+        }
+        if (entry.cell == search->goal) {
+            return entry.g;
+        }
+        search->expanded++;
+        Cell nbrs[8];
+        int n = gridMoves(search->blocked, l, b, lm->moves, entry.cell, nbrs);
+        for (int i=0; i<n; i++) {
+            Cell g = entry.g + 1;
+            if (search->reached[nbrs[i]] == search->query && search->g[nbrs[i]] <= g) {
+                continue;
+            }
+            size_t f = g + lowerBound(search, nbrs[i]);
+            if (f >= limit) {
+                pruned = true;
+                continue;
+            }
+            search->reached[nbrs[i]] = search->query;
+            search->g[nbrs[i]] = g;
+            pushOpen(search, (OpenEntry) { f, g, nbrs[i] });
         }
     }
+    if (!pruned) {
+        search->exhausted      = search->query;
+        search->exhausted_goal = search->goal;
+    }
+    return 0;
+}
 
-    /* find path size for leftwards branch */
-    if(current->x > 0 && take_left) {
-        Position left  = safemalloc(sizeof *left);
-        left->x = current->x-1; left->y = current->y;
-        size_t left_value = find_path(objects, o_size, target, left, l, b);
-        if (left_value < top_value && left_value!=NULL) {
-            free(candidate);
-            candidate = left;
-        } else {
-            free(left);
+/// step onto the move with the shortest path to the goal
+struct pos searchNextStep(PathSearch search, const struct pos* current, const struct pos* goal) {
+    Landmarks lm = search->lm;
+    struct pos next = *current;
+    Cell cell = cellAt(current->x, current->y, lm->b);
+    Cell nbrs[8];
+    size_t top_value = SIZE_MAX;
+    int n = gridMoves(search->blocked, lm->l, lm->b, lm->moves, cell, nbrs);
+    for (int i=0; i<n; i++) {
+        // only a strictly shorter path replaces the best move so far, so longer ones are cut off
+        struct pos move = { (Coord) (nbrs[i] % lm->b), (Coord) (nbrs[i] / lm->b) };
+        size_t value = pathLength(search, &move, goal, top_value);
+        if (value != 0) {
+            top_value = value;
+            next = move;
         }
     }
+    return next;
+}
+
+/// Finds the size of the shortest path
+size_t find_path(Position* objects, size_t o_size, Position target, Position source, size_t l, size_t b,
+                 Neighborhood moves) {
+    DistanceField field = makeDistanceField(l, b, moves);
+    computeDistances(field, objects, o_size, target);
+    size_t length = fieldDistance(field, source);
+    freeDistanceField(field);
+    return length;
+}
 
+/// Find the first node of the shortest path
+Position shortest_path(Position* objects, size_t o_size, Position current, Position target, size_t l, size_t b,
+                       Neighborhood moves) {
+    DistanceField field = makeDistanceField(l, b, moves);
+    computeDistances(field, objects, o_size, target);
+    Position candidate = safemalloc(sizeof *candidate, MEM_PATHFINDING);
+    *candidate = fieldNextStep(field, current);
+    freeDistanceField(field);
     return candidate;
-}
\ No newline at end of file
+}
@@ -3,15 +3,121 @@
 
 #include "robot.h"
 
+/// marks cells a distance field could not reach
+#define UNREACHABLE (-1)
+
+/// number of moves from every cell of the grid to one goal cell,
+/// kept between searches so its buffers are reused
+typedef struct distance_field {
+    size_t l;
+    size_t b;
+    Neighborhood moves;
+    unsigned char* blocked;     // cells taken by objects, indexed y*b+x
+    int* dist;                  // moves to the goal, or UNREACHABLE, indexed y*b+x
+    Cell* queue;
+    Cell goal;                  // cell the field was computed for, NO_CELL if it is off the grid
+} *DistanceField;
+
+/// Lists the cells a robot at {cell} can move to in one round: up-right, up-left, down-right and
+/// down-left if the neighborhood has diagonals, then up, down, right and left.
+/// Diagonals come first so that ties between equally short paths take the diagonal step.
+/// A diagonal move needs both cells whose corner it cuts to be free, so that robots never
+/// squeeze past each other.
+/// @param blocked nonzero for taken cells indexed y*b+x, or NULL to list every neighbor on the grid
+/// @returns the number of cells written to {out}
+int gridMoves(const unsigned char* blocked, size_t l, size_t b, Neighborhood moves, Cell cell, Cell out[8]);
+
+/// lower bound on the moves between two cells: Manhattan distance for 4-connected moves,
+/// Chebyshev distance for 8-connected moves
+size_t gridDistance(Neighborhood moves, int x0, int y0, int x1, int y1);
+
+/// create a distance field for a {l}x{b} grid
+DistanceField makeDistanceField(size_t l, size_t b, Neighborhood moves);
+
+/// free a distance field
+void freeDistanceField(DistanceField field);
+
+/// Fills the field with the number of moves from every cell to {goal}, with one breadth-first
+/// search outwards from the goal. Cells of {objects} are obstacles, so if the goal itself
+/// is taken every cell is unreachable.
+void computeDistances(DistanceField field, Position* objects, size_t o_size, const struct pos* goal);
+
+/// Length of the shortest path from {source} to the field's goal, where {source} may be taken.
+/// @returns 1 if the source is the goal, 0 if the goal cannot be reached
+size_t fieldDistance(DistanceField field, const struct pos* source);
+
+/// number of landmarks placed on a grid, each costs one int per cell
+#define ALT_LANDMARKS 4
+
+/// A* search bounded by landmarks, with buffers reused between queries; each thread needs its own
+typedef struct path_search *PathSearch;
+
+/// Distances from a few landmark cells to every cell of the grid, computed once per layout of cells
+/// which never become free. For any landmark L, |d(L,u) - d(L,v)| is a lower bound on the path length
+/// d(u,v), which holds however many more cells are taken later. Shared read-only by all searches.
+typedef struct landmarks {
+    size_t l;
+    size_t b;
+    Neighborhood moves;         // moves the landmarks were placed for, 0 before they are placed
+    unsigned char* walls;       // cells which never become free, indexed y*b+x
+    size_t n_walls;
+    size_t n;                   // number of landmarks placed
+    Cell cells[ALT_LANDMARKS];
+    int* dist;                  // moves from landmark i to each cell at dist[i*l*b + cell], or UNREACHABLE
+    atomic_ullong queries;      // A* searches run by freed searches, queries cut off by their bound are not counted
+    atomic_ullong expanded;     // cells expanded by those searches
+    PathSearch idle;            // freed searches, handed out again until the landmarks are placed anew
+    pthread_mutex_t idle_lock;
+} *Landmarks;
+
+/// create landmarks for a {l}x{b} grid, placeLandmarks must be called before they are used
+Landmarks makeLandmarks(size_t l, size_t b);
+
+/// free landmarks
+void freeLandmarks(Landmarks lm);
+
+/// Places the landmarks for robots making {moves} around the cells of {walls}, which must never
+/// become free while the landmarks are used. The landmarks are picked far apart from each other
+/// (the corners of an open grid), which takes ALT_LANDMARKS+1 breadth-first searches.
+void placeLandmarks(Landmarks lm, Neighborhood moves, Position* walls, size_t n_walls);
+
+/// create a search on the grid of {lm}, with no obstacles but its walls;
+/// a search freed earlier is reused, so searches made every round do not allocate their grids again
+PathSearch makePathSearch(Landmarks lm);
+
+/// free a search and add its query counters to its landmarks, which keep it for the next makePathSearch
+void freePathSearch(PathSearch search);
+
+/// take the cells of {objects} as obstacles of the following queries, instead of the previous ones
+void setPathObstacles(PathSearch search, Position* objects, size_t o_size);
+
+/// Length of the shortest path from {source}, which may itself be taken, to {goal} found by A*.
+/// The landmarks' bounds steer the search towards the goal and cut off every path of
+/// {limit} moves or more, so a caller only after a shorter path than it knows expands few cells.
+/// @returns 1 if the source is the goal, 0 if there is no path shorter than {limit}
+size_t pathLength(PathSearch search, const struct pos* source, const struct pos* goal, size_t limit);
+
+/// first step from {current} along the shortest path to {goal}, ties are broken in the order of gridMoves;
+/// the same as fieldNextStep on a distance field of the goal, without searching the whole grid
+/// @returns {current} if the goal cannot be reached
+struct pos searchNextStep(PathSearch search, const struct pos* current, const struct pos* goal);
+
 /// Determines the shortest path from a robots current position to it's assigned position,
 /// accounting for obstacles in between
 /// @returns the next Position node in the shortest path, must be free'd after use
-Position shortest_path(Position* objects, size_t o_size, Position current, Position target, size_t l, size_t b);
+Position shortest_path(Position* objects, size_t o_size, Position current, Position target, size_t l, size_t b,
+                       Neighborhood moves);
+
+/// first step from {current} along the shortest path to the goal of a computed {field},
+/// ties are broken in the order of gridMoves
+/// @returns {current} if no step gets closer to the goal
+struct pos fieldNextStep(DistanceField field, const struct pos* current);
 
 /// Finds the path length of the shortest path.
 /// If the source == target position, the path length is 1.
 /// Implements breadth-first search algorithm.
-/// @returns size of path found (>1); if no path was found return NULL
-size_t find_path(Position* objects, size_t o_size, Position target, Position source, size_t l, size_t b);
+/// @returns size of path found (>=1); if no path was found return 0
+size_t find_path(Position* objects, size_t o_size, Position target, Position source, size_t l, size_t b,
+                 Neighborhood moves);
 
 #endif //CSCI251_PROJECT3_PATHFINDING_H
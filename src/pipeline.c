@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "pipeline.h"
+#include "utils/display.h"
+#include "utils/log.h"
+
+/// what a frame buffer is being used for
+typedef enum frame_state {
+    FRAME_FREE,         // may be filled by the simulation
+    FRAME_FILLING,      // being filled by the simulation
+    FRAME_QUEUED,       // filled, waiting for the render stage
+    FRAME_RENDERING     // being drawn
+} FrameState;
+
+struct pipeline {
+    Frame frames[2];
+    FrameState states[2];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // signalled whenever a frame changes state
+    bool stopping;
+    double frame_rate;          // most frames drawn per second, 0 = unlimited
+    size_t drawn;
+    size_t dropped;             // frames replaced by a newer one before they were drawn
+};
+
+static void addSeconds(struct timespec* t, double seconds) {
+    long ns = t->tv_nsec + (long) (seconds * 1e9);
+    t->tv_sec += ns / 1000000000L;
+    t->tv_nsec = ns % 1000000000L;
+}
+
+static bool before(const struct timespec* a, const struct timespec* b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/// index of a frame in the given state, or -1
+static int findFrame(Pipeline p, FrameState state) {
+    for (int i=0; i<2; i++) {
+        if (p->states[i] == state) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// render stage: draw the latest queued frame once per frame interval until stopped
+static void* renderStage(void* p_void) {
+    Pipeline p = (Pipeline) p_void;
+    struct timespec next_draw;
+    clock_gettime(CLOCK_MONOTONIC, &next_draw);
+    pthread_mutex_lock(&p->lock);
+    while (true) {
+        int i;
+        while ((i = findFrame(p, FRAME_QUEUED)) < 0 && !p->stopping) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (i < 0) {
+            break;  // stopping and nothing left to draw
+        }
+
+        // frames published until the next draw is due replace the queued one
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (!p->stopping && before(&now, &next_draw)) {
+            pthread_cond_timedwait(&p->changed, &p->lock, &next_draw);
+            continue;
+        }
+        p->states[i] = FRAME_RENDERING;
+        pthread_mutex_unlock(&p->lock);
+
+        // what was logged up to this frame's round is written out above it
+        Frame* f = &p->frames[i];
+        log_flush();
+        update_display(f->l, f->b, f->k, f->phase, f->round, f->positions, f->malicious, &f->target,
+                       f->status[0] != '\0' ? f->status : NULL);
+        if (p->frame_rate > 0) {
+            next_draw = now;
+            addSeconds(&next_draw, 1.0 / p->frame_rate);
+        }
+
+        pthread_mutex_lock(&p->lock);
+        p->states[i] = FRAME_FREE;
+        p->drawn++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/// start the render stage
+Pipeline startPipeline(size_t k, double frame_rate) {
+    Pipeline p = safemalloc(sizeof *p, MEM_DISPLAY);
+    for (int i=0; i<2; i++) {
+        p->frames[i].positions = safemalloc(k * sizeof *(p->frames[i].positions), MEM_DISPLAY);
+        p->frames[i].malicious = safemalloc(k * sizeof *(p->frames[i].malicious), MEM_DISPLAY);
+        p->states[i] = FRAME_FREE;
+    }
+    p->stopping   = false;
+    p->frame_rate = frame_rate;
+    p->drawn      = 0;
+    p->dropped    = 0;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&p->lock, NULL);
+    int code = pthread_create(&p->thread, NULL, &renderStage, p);
+    if (code) {
+        printf("Thread creation failed!");
+        exit(code);
+    }
+    return p;
+}
+
+/// hand a copy of the simulation to the render stage
+void publishFrame(Pipeline p, Simulation sim, int phase, const char* status) {
+    // at most one frame is drawn at a time, so the other one is either free or still queued,
+    // in which case it is outdated by this one and dropped
+    pthread_mutex_lock(&p->lock);
+    int i = findFrame(p, FRAME_QUEUED);
+    if (i >= 0) {
+        p->dropped++;
+    } else {
+        i = findFrame(p, FRAME_FREE);
+    }
+    p->states[i] = FRAME_FILLING;
+    pthread_mutex_unlock(&p->lock);
+
+    // the render stage never touches a frame being filled, so it is filled without holding the lock
+    Frame* f = &p->frames[i];
+    size_t k;
+    simulationSize(sim, &f->l, &f->b);
+    f->phase  = phase;
+    f->round  = simulationRound(sim);
+    f->target = *targetPosition(sim);
+    const struct pos* positions = robotPositions(sim, &k);
+    Robot const* robots = simulationRobots(sim, &k);
+    f->k = k;
+    for (size_t j=0; j<k; j++) {
+        f->positions[j] = positions[j];
+        f->malicious[j] = robots[j]->malicious;
+    }
+    f->status[0] = '\0';
+    if (status != NULL) {
+        strncat(f->status, status, FRAME_STATUS_MAX-1);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->states[i] = FRAME_QUEUED;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/// stop the render stage
+void stopPipeline(Pipeline p) {
+    pthread_mutex_lock(&p->lock);
+    p->stopping = true;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    log_info("Drew %zu frames, dropped %zu frames the render stage fell behind on\n", p->drawn, p->dropped);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->changed);
+    for (int i=0; i<2; i++) {
+        safefree(p->frames[i].positions);
+        safefree(p->frames[i].malicious);
+    }
+    safefree(p);
+}
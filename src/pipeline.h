@@ -0,0 +1,43 @@
+#ifndef CSCI251_PROJECT3_PIPELINE_H
+#define CSCI251_PROJECT3_PIPELINE_H
+
+#include <glob.h>
+#include <stdbool.h>
+#include "simulation.h"
+
+/// longest status line shown below a frame, including the terminating null
+#define FRAME_STATUS_MAX 96
+
+/// copy of everything drawn for one round, so it can be drawn while the next round runs
+typedef struct frame {
+    size_t l;
+    size_t b;
+    size_t k;
+    int phase;
+    int round;
+    struct pos target;
+    struct pos* positions;  // indexed by robot ID
+    bool* malicious;        // indexed by robot ID
+    char status[FRAME_STATUS_MAX];  // line drawn below the phase, e.g. the playback controls
+} Frame;
+
+/// render stage which draws frames on its own thread while the simulation goes on
+/// two frames are double-buffered: the simulation fills one while the other is drawn
+/// the render stage draws at its own cadence, and a frame which is still waiting when
+/// a newer one is published is dropped, so the simulation never waits for the terminal
+typedef struct pipeline *Pipeline;
+
+/// start the render stage for a simulation with {k} robots
+/// @param frame_rate most frames drawn per second, 0 to draw as often as frames arrive
+Pipeline startPipeline(size_t k, double frame_rate);
+
+/// copy the state of {sim} into a frame and hand it to the render stage, replacing
+/// the frame it has not picked up yet if there is one; never blocks on rendering
+/// @param phase the phase to show, which may differ from the simulation's own when quitting early
+/// @param status line to show below the phase, or NULL
+void publishFrame(Pipeline pipeline, Simulation sim, int phase, const char* status);
+
+/// draw the last published frame, stop the render stage and free it
+void stopPipeline(Pipeline pipeline);
+
+#endif //CSCI251_PROJECT3_PIPELINE_H
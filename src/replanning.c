@@ -0,0 +1,495 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "replanning.h"
+#include "pathfinding.h"
+
+#define INF        (INT64_MAX / 4)
+#define NOT_QUEUED NO_CELL
+
+/// search state of one cell the planner has touched
+typedef struct node {
+    int64_t g;          // current distance estimate to the goal
+    int64_t rhs;        // one-step lookahead of g
+    Cell cell;
+    Cell heap;          // position in the priority queue, or NOT_QUEUED
+    bool used;
+} Node;
+
+/// priority of a queued cell, compared lexicographically
+typedef struct key {
+    int64_t k1;
+    int64_t k2;
+} Key;
+
+typedef struct entry {
+    Key key;
+    Cell cell;
+} Entry;
+
+struct planner {
+    Occupancy occ;
+    Cell goal;
+    Cell start;         // cell the robot is planning from
+    Cell last;          // start of the previous call, used to offset stale keys
+    int64_t km;         // accumulated heuristic offset since the search began
+    bool started;
+    size_t cursor;      // occupancy changes already applied to the search
+    size_t slot;        // index among the occupancy's planners
+    int x0, y0, x1, y1; // bounding box of the cells in the node table
+
+    Node* nodes;        // open-addressing table of touched cells, only those are stored
+    size_t cap;
+    size_t count;
+
+    Entry* heap;
+    size_t heap_size;
+    size_t heap_cap;
+};
+
+/** Occupancy grid **/
+
+/// create an empty occupancy grid
+Occupancy makeOccupancy(size_t l, size_t b, Neighborhood moves) {
+    Occupancy occ = safemalloc(sizeof *occ, MEM_PLANNING);
+    occ->l = l;
+    occ->b = b;
+    occ->moves = moves;
+    occ->blocked     = safecalloc(l*b, sizeof *(occ->blocked), MEM_PLANNING);
+    occ->cap_changes = 64;
+    occ->n_changes   = 0;
+    occ->n_freed     = 0;
+    occ->first       = 0;
+    occ->changes     = safemalloc(occ->cap_changes * sizeof *(occ->changes), MEM_PLANNING);
+    occ->cap_planners = 16;
+    occ->n_planners   = 0;
+    occ->planners     = safemalloc(occ->cap_planners * sizeof *(occ->planners), MEM_PLANNING);
+    return occ;
+}
+
+/// free an occupancy grid, detaching its planners
+void freeOccupancy(Occupancy occ) {
+    for (size_t i=0; i<occ->n_planners; i++) {
+        occ->planners[i]->occ = NULL;
+    }
+    safefree(occ->blocked);
+    safefree(occ->changes);
+    safefree(occ->planners);
+    safefree(occ);
+}
+
+/// record that a cell switched between blocked and free
+static void logChange(Occupancy occ, Cell cell) {
+    if (occ->n_changes - occ->first == occ->cap_changes) {
+        occ->cap_changes *= 2;
+        occ->changes = saferealloc(occ->changes, occ->cap_changes * sizeof *(occ->changes), MEM_PLANNING);
+    }
+    occ->changes[occ->n_changes++ - occ->first] = cell;
+}
+
+/// one more robot/object in a cell
+void occupy(Occupancy occ, int x, int y) {
+    Cell cell = cellAt(x, y, occ->b);
+    if (occ->blocked[cell]++ == 0) {
+        logChange(occ, cell);
+    }
+}
+
+/// one less robot/object in a cell
+void vacate(Occupancy occ, int x, int y) {
+    Cell cell = cellAt(x, y, occ->b);
+    if (--occ->blocked[cell] == 0) {
+        logChange(occ, cell);
+        occ->n_freed++;
+    }
+}
+
+/** Node table **/
+
+static size_t hashCell(Cell cell, size_t mask) {
+    return (size_t) ((cell * 0x9e3779b97f4a7c15ULL) >> 17) & mask;
+}
+
+/// find the node of a cell, or NULL if the planner never touched it
+static Node* findNode(Planner p, Cell cell) {
+    size_t h = hashCell(cell, p->cap-1);
+    while (p->nodes[h].used) {
+        if (p->nodes[h].cell == cell) {
+            return &p->nodes[h];
+        }
+        h = (h+1) & (p->cap-1);
+    }
+    return NULL;
+}
+
+/// grow the node table, queued nodes are re-linked to their heap entries
+static void growNodes(Planner p) {
+    Node* old = p->nodes;
+    size_t old_cap = p->cap;
+    p->cap *= 2;
+    p->nodes = safecalloc(p->cap, sizeof *(p->nodes), MEM_PLANNING);
+    for (size_t i=0; i<old_cap; i++) {
+        if (old[i].used) {
+            size_t h = hashCell(old[i].cell, p->cap-1);
+            while (p->nodes[h].used) {
+                h = (h+1) & (p->cap-1);
+            }
+            p->nodes[h] = old[i];
+        }
+    }
+    safefree(old);
+}
+
+/// get the node of a cell, adding an unexplored one if needed
+/// may move other nodes, so earlier Node pointers must not be kept
+static Node* getNode(Planner p, Cell cell) {
+    Node* node = findNode(p, cell);
+    if (node != NULL) {
+        return node;
+    }
+    if (2*(p->count+1) > p->cap) {
+        growNodes(p);
+    }
+    size_t h = hashCell(cell, p->cap-1);
+    while (p->nodes[h].used) {
+        h = (h+1) & (p->cap-1);
+    }
+    node = &p->nodes[h];
+    node->used = true;
+    node->cell = cell;
+    node->g    = INF;
+    node->rhs  = (cell == p->goal) ? 0 : INF;
+    node->heap = NOT_QUEUED;
+    p->count++;
+    int x = (int) (cell % p->occ->b), y = (int) (cell / p->occ->b);
+    p->x0 = x < p->x0 ? x : p->x0;
+    p->y0 = y < p->y0 ? y : p->y0;
+    p->x1 = x > p->x1 ? x : p->x1;
+    p->y1 = y > p->y1 ? y : p->y1;
+    return node;
+}
+
+static int64_t g(Planner p, Cell cell) {
+    Node* node = findNode(p, cell);
+    return node != NULL ? node->g : INF;
+}
+
+/** Priority queue **/
+
+static bool keyLess(Key a, Key b) {
+    return a.k1 < b.k1 || (a.k1 == b.k1 && a.k2 < b.k2);
+}
+
+/// distance from the start on an empty grid, consistent since every move costs 1
+static int64_t heuristic(Planner p, Cell from, Cell to) {
+    size_t b = p->occ->b;
+    return (int64_t) gridDistance(p->occ->moves, (int) (from % b), (int) (from / b), (int) (to % b), (int) (to / b));
+}
+
+static Key calcKey(Planner p, Node* node) {
+    int64_t m = node->g < node->rhs ? node->g : node->rhs;
+    Key key = { m >= INF ? INF : m + heuristic(p, p->start, node->cell) + p->km, m };
+    return key;
+}
+
+static void heapSet(Planner p, size_t i, Entry entry) {
+    p->heap[i] = entry;
+    findNode(p, entry.cell)->heap = (Cell) i;
+}
+
+static void siftUp(Planner p, size_t i) {
+    Entry entry = p->heap[i];
+    while (i > 0 && keyLess(entry.key, p->heap[(i-1)/2].key)) {
+        heapSet(p, i, p->heap[(i-1)/2]);
+        i = (i-1)/2;
+    }
+    heapSet(p, i, entry);
+}
+
+static void siftDown(Planner p, size_t i) {
+    Entry entry = p->heap[i];
+    for (;;) {
+        size_t child = 2*i + 1;
+        if (child >= p->heap_size) {
+            break;
+        }
+        if (child+1 < p->heap_size && keyLess(p->heap[child+1].key, p->heap[child].key)) {
+            child++;
+        }
+        if (!keyLess(p->heap[child].key, entry.key)) {
+            break;
+        }
+        heapSet(p, i, p->heap[child]);
+        i = child;
+    }
+    heapSet(p, i, entry);
+}
+
+static void heapPush(Planner p, Cell cell, Key key) {
+    if (p->heap_size == p->heap_cap) {
+        p->heap_cap *= 2;
+        p->heap = saferealloc(p->heap, p->heap_cap * sizeof *(p->heap), MEM_PLANNING);
+    }
+    Entry entry = { key, cell };
+    p->heap[p->heap_size++] = entry;
+    siftUp(p, p->heap_size-1);
+}
+
+static void heapRemove(Planner p, Node* node) {
+    size_t i = node->heap;
+    node->heap = NOT_QUEUED;
+    p->heap_size--;
+    if (i == p->heap_size) {
+        return;
+    }
+    p->heap[i] = p->heap[p->heap_size];
+    findNode(p, p->heap[i].cell)->heap = i;
+    if (i > 0 && keyLess(p->heap[i].key, p->heap[(i-1)/2].key)) {
+        siftUp(p, i);
+    } else {
+        siftDown(p, i);
+    }
+}
+
+/// change the key of a queued node
+static void heapUpdate(Planner p, Node* node, Key key) {
+    size_t i = node->heap;
+    p->heap[i].key = key;
+    if (i > 0 && keyLess(key, p->heap[(i-1)/2].key)) {
+        siftUp(p, i);
+    } else {
+        siftDown(p, i);
+    }
+}
+
+/** D* Lite **/
+
+/// the in-bounds neighbors of a cell, whose edges to it may change with its occupancy
+static int neighbors(Planner p, Cell cell, Cell out[8]) {
+    return gridMoves(NULL, p->occ->l, p->occ->b, p->occ->moves, cell, out);
+}
+
+/// the cells a robot can move to from a cell with the current occupancy
+static int successors(Planner p, Cell cell, Cell out[8]) {
+    return gridMoves(p->occ->blocked, p->occ->l, p->occ->b, p->occ->moves, cell, out);
+}
+
+/// recompute a cell's lookahead and requeue it if it became inconsistent
+static void updateVertex(Planner p, Cell cell) {
+    int64_t rhs = 0;
+    if (cell != p->goal) {
+        rhs = INF;
+        if (!p->occ->blocked[cell]) {
+            Cell nbrs[8];
+            int n = successors(p, cell, nbrs);
+            for (int i=0; i<n; i++) {
+                int64_t gv = g(p, nbrs[i]);
+                if (gv < INF && gv+1 < rhs) {
+                    rhs = gv+1;
+                }
+            }
+        }
+    }
+
+    Node* node = findNode(p, cell);
+    if (node == NULL) {
+        if (rhs >= INF) {
+            return;     // untouched cells are already consistent at infinity
+        }
+        node = getNode(p, cell);
+    }
+    if (node->rhs == rhs && (node->heap != NOT_QUEUED || node->g == rhs)) {
+        return;     // a queued key can only be too small, which is fixed when it comes up
+    }
+    node->rhs = rhs;
+    if (node->g == node->rhs) {
+        if (node->heap != NOT_QUEUED) {
+            heapRemove(p, node);
+        }
+    } else if (node->heap != NOT_QUEUED) {
+        heapUpdate(p, node, calcKey(p, node));
+    } else {
+        heapPush(p, cell, calcKey(p, node));
+    }
+}
+
+/// the search is done once every target cell is consistent and no queued key is smaller
+static bool settled(Planner p, const Cell* targets, int n_targets) {
+    if (p->heap_size == 0) {
+        return true;
+    }
+    Key top = p->heap[0].key;
+    for (int i=0; i<n_targets; i++) {
+        Node* node = findNode(p, targets[i]);
+        if (node == NULL) {
+            Key inf = { INF, INF };
+            if (keyLess(top, inf)) return false;
+        } else if (node->g != node->rhs || keyLess(top, calcKey(p, node))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void computeShortestPath(Planner p, const Cell* targets, int n_targets) {
+    while (!settled(p, targets, n_targets)) {
+        Cell cell = p->heap[0].cell;
+        Node* node  = findNode(p, cell);
+        Key k_old   = p->heap[0].key;
+        Key k_new   = calcKey(p, node);
+        Cell nbrs[8];
+        int n = neighbors(p, cell, nbrs);
+        if (keyLess(k_old, k_new)) {
+            p->heap[0].key = k_new;
+            siftDown(p, 0);
+        } else if (node->g > node->rhs) {
+            node->g = node->rhs;
+            heapRemove(p, node);
+            for (int i=0; i<n; i++) {
+                updateVertex(p, nbrs[i]);
+            }
+        } else {
+            node->g = INF;
+            updateVertex(p, cell);
+            for (int i=0; i<n; i++) {
+                updateVertex(p, nbrs[i]);
+            }
+        }
+    }
+}
+
+/// forget the search, the next call to plannerNextStep searches from scratch
+static void restartPlanner(Planner p) {
+    p->km        = 0;
+    p->started   = false;
+    p->count     = 0;
+    p->heap_size = 0;
+    p->x0 = p->y0 = INT32_MAX;
+    p->x1 = p->y1 = -1;
+    memset(p->nodes, 0, p->cap * sizeof *(p->nodes));
+}
+
+/// create a planner
+Planner makePlanner(Occupancy occ, int x, int y) {
+    Planner p = safemalloc(sizeof *p, MEM_PLANNING);
+    p->occ      = occ;
+    p->goal     = cellAt(x, y, occ->b);
+    p->start    = p->goal;
+    p->last     = p->goal;
+    p->cursor   = 0;
+    p->cap      = 64;
+    p->nodes    = safecalloc(p->cap, sizeof *(p->nodes), MEM_PLANNING);
+    p->heap_cap = 64;
+    p->heap     = safemalloc(p->heap_cap * sizeof *(p->heap), MEM_PLANNING);
+    restartPlanner(p);
+
+    if (occ->n_planners == occ->cap_planners) {
+        occ->cap_planners *= 2;
+        occ->planners = saferealloc(occ->planners, occ->cap_planners * sizeof *(occ->planners), MEM_PLANNING);
+    }
+    p->slot = occ->n_planners;
+    occ->planners[occ->n_planners++] = p;
+    return p;
+}
+
+/// free a planner, taking it off its occupancy's planners
+void freePlanner(Planner planner) {
+    Occupancy occ = planner->occ;
+    if (occ != NULL) {
+        Planner moved = occ->planners[--occ->n_planners];
+        occ->planners[planner->slot] = moved;
+        moved->slot = planner->slot;
+    }
+    safefree(planner->nodes);
+    safefree(planner->heap);
+    safefree(planner);
+}
+
+/// drop the changes every planner has replayed
+void compactChanges(Occupancy occ) {
+    size_t keep = occ->n_changes;
+    for (size_t i=0; i<occ->n_planners; i++) {
+        Planner p = occ->planners[i];
+        if (p->started && occ->n_changes - p->cursor > occ->l * occ->b) {
+            restartPlanner(p);
+        } else if (p->started && p->cursor < keep) {
+            keep = p->cursor;
+        }
+    }
+    if (keep > occ->first) {
+        memmove(occ->changes, occ->changes + (keep - occ->first),
+                (occ->n_changes - keep) * sizeof *(occ->changes));
+        occ->first = keep;
+    }
+}
+
+/// whether a change of {cell} can affect the search: only cells within 1 tile of a
+/// neighbor of the cell are read when its neighbors are updated, and cells which were
+/// never touched have no distance yet
+static bool nearSearch(Planner p, Cell cell) {
+    int x = (int) (cell % p->occ->b), y = (int) (cell / p->occ->b);
+    return x + 2 >= p->x0 && x - 2 <= p->x1 && y + 2 >= p->y0 && y - 2 <= p->y1;
+}
+
+/// next step towards the goal
+struct pos plannerNextStep(Planner p, const struct pos* current) {
+    struct pos next = *current;
+    Cell start = cellAt(current->x, current->y, p->occ->b);
+    if (start == p->goal) {
+        return next;
+    }
+
+    if (!p->started) {
+        // first search: queue the goal and ignore changes made before now
+        p->started = true;
+        p->start   = start;
+        p->last    = start;
+        p->cursor  = p->occ->n_changes;
+        Node* goal = getNode(p, p->goal);
+        heapPush(p, p->goal, calcKey(p, goal));
+    } else {
+        // the robot moved: offset every queued key instead of recomputing them
+        p->km   += heuristic(p, p->last, start);
+        p->last  = start;
+        p->start = start;
+
+        // repair the search around every cell whose occupancy changed near it; the change only
+        // adds or removes edges between the cell and its neighbors, and a lookahead can only
+        // change through such an edge if one of those cells has a distance
+        for (; p->cursor < p->occ->n_changes; p->cursor++) {
+            Cell cell = p->occ->changes[p->cursor - p->occ->first];
+            if (!nearSearch(p, cell)) {
+                continue;
+            }
+            Cell around[9] = { cell };
+            int n = 1 + neighbors(p, cell, around + 1);
+            bool reached = false;
+            for (int i=0; i<n && !reached; i++) {
+                reached = g(p, around[i]) < INF;
+            }
+            for (int i=0; i<n && reached; i++) {
+                updateVertex(p, around[i]);
+            }
+        }
+    }
+
+    // only cells the robot can move to are candidate steps
+    Cell targets[8];
+    int n_targets = successors(p, start, targets);
+    if (n_targets == 0) {
+        return next;
+    }
+    computeShortestPath(p, targets, n_targets);
+
+    // step onto the candidate closest to the goal, earlier directions win ties
+    int64_t best = INF;
+    for (int i=0; i<n_targets; i++) {
+        int64_t gv = g(p, targets[i]);
+        if (gv < best) {
+            best   = gv;
+            next.x = (Coord) (targets[i] % p->occ->b);
+            next.y = (Coord) (targets[i] / p->occ->b);
+        }
+    }
+    return next;
+}
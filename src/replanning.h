@@ -0,0 +1,57 @@
+#ifndef CSCI251_PROJECT3_REPLANNING_H
+#define CSCI251_PROJECT3_REPLANNING_H
+
+#include <glob.h>
+#include "robot.h"
+
+/// occupied cells of the grid together with a log of every cell whose state changed
+/// planners replay the log to learn which parts of their search must be repaired,
+/// entries every planner has replayed are dropped by compactChanges
+typedef struct occupancy {
+    size_t l;
+    size_t b;
+    Neighborhood moves;         // moves planners on this grid may use
+    unsigned char* blocked;     // number of robots/objects in each cell, indexed y*b+x
+    Cell* changes;              // cells which became blocked or free, oldest first, from change number {first} on
+    size_t first;               // number of changes dropped from the log
+    size_t n_changes;           // number of changes ever logged
+    size_t cap_changes;
+    size_t n_freed;             // number of times a cell became free
+    struct planner** planners;  // planners on the grid, which keep their place in the log
+    size_t n_planners;
+    size_t cap_planners;
+} *Occupancy;
+
+/// incremental shortest-path search (D* Lite) towards a single goal cell
+typedef struct planner *Planner;
+
+/// create an empty occupancy grid of size {l}x{b} for robots making {moves}
+Occupancy makeOccupancy(size_t l, size_t b, Neighborhood moves);
+
+/// free an occupancy grid, its planners must not be used any more but may still be freed
+void freeOccupancy(Occupancy occ);
+
+/// mark the cell at ({x}, {y}) as taken by one more robot or object
+void occupy(Occupancy occ, int x, int y);
+
+/// mark the cell at ({x}, {y}) as taken by one less robot or object
+void vacate(Occupancy occ, int x, int y);
+
+/// Drops the changes every planner has replayed. A planner further behind than there are cells
+/// on the grid starts its search over when it is next used, since that is cheaper than replaying.
+void compactChanges(Occupancy occ);
+
+/// create a planner towards the goal ({x}, {y}) on the grid described by {occ}
+Planner makePlanner(Occupancy occ, int x, int y);
+
+/// free a planner
+void freePlanner(Planner planner);
+
+/// Determines the first step of the shortest path from {current} to the planner's goal,
+/// treating every occupied cell (including {current} itself) as an obstacle.
+/// Only the parts of the previous search affected by occupancy changes since the last
+/// call are recomputed. Ties are broken in the order of gridMoves.
+/// @returns the next position, or {current} if the goal cannot be reached
+struct pos plannerNextStep(Planner planner, const struct pos* current);
+
+#endif //CSCI251_PROJECT3_REPLANNING_H
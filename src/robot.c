@@ -5,51 +5,71 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "robot.h"
 #include "pathfinding.h"
+#include "replanning.h"
+#include "scheduling.h"
+#include "spatial.h"
+#include "coverage.h"
+#include "mapping.h"
+#include "utils/log.h"
 
 /// initialize a robot
 Robot makeRobot(size_t ID, Position pos, bool malicious, size_t l, size_t b) {
-    Robot rob = safemalloc(sizeof *rob);
+    Robot rob = safemalloc(sizeof *rob, MEM_ROBOTS);
     rob->ID             = ID;
     rob->self           = pos;
     rob->target         = NULL;
     rob->assignment     = NULL;
     rob->malicious      = malicious;
-    rob->receive_buffer = safemalloc(sizeof *(rob->receive_buffer));
-    rob->send_buffer    = safemalloc(sizeof *(rob->send_buffer));
+    rob->inbox          = NULL;
+    rob->accusations    = 0;
+    rob->planner        = NULL;
+    rob->occupancy      = NULL;
+    rob->schedule       = NULL;
+    rob->coverage       = NULL;
+    rob->delta          = makeDelta();
+    rob->n_history      = 0;
+    rob->suspected      = false;
+    rob->crashed        = false;
+    rob->receive_buffer = safemalloc(sizeof *(rob->receive_buffer), MEM_ROBOTS);
+    rob->send_buffer    = safemalloc(sizeof *(rob->send_buffer), MEM_ROBOTS);
 
     /* initialize the explore mapping */
-    rob->explored = safemalloc(sizeof *(rob->explored) * b);
-    for (int x=0;x<b;x++) {
-        rob->explored[x] = calloc(sizeof *(rob->explored), l);
-        for (int y=0;y<l;y++) {
-            rob->explored[x][y] = false;
-        }
-    }
+    rob->explored = safecalloc(l*b, sizeof *(rob->explored), MEM_ROBOTS);
     return rob;
 }
 
 /// free memory locations associated with a robot
 void freeRobot(Robot robot, size_t l, size_t b) {
-    if(robot->self != NULL) {
-        free(robot->self);
-    }
     if(robot->assignment != NULL) {
-        free(robot->assignment);
+        safefree(robot->assignment);
+    }
+    if(robot->target != NULL) {
+        safefree(robot->target);
+    }
+    if(robot->planner != NULL) {
+        freePlanner(robot->planner);
+    }
+    if(robot->occupancy != NULL) {
+        freeOccupancy(robot->occupancy);
+    }
+    if(robot->schedule != NULL) {
+        freeSchedule(robot->schedule);
     }
-    free(robot->receive_buffer);
-    free(robot->send_buffer);
-    for (int x=0;x<b;x++) {
-        free(robot->explored[x]);
+    if(robot->coverage != NULL) {
+        freeCoverage(robot->coverage);
     }
-    free(robot->explored);
-    free(robot);
+    freeDelta(robot->delta);
+    safefree(robot->receive_buffer);
+    safefree(robot->send_buffer);
+    safefree(robot->explored);
+    safefree(robot);
 }
 
 /// make the robot move to the next position as specified in it's buffer
-void* moveRobot(void* robot_void) {
-    Robot robot = (Robot) robot_void;
+void moveRobot(Robot robot) {
     if (abs(robot->receive_buffer->x - robot->self->x)<=1
         && abs(robot->receive_buffer->y - robot->self->y)<=1) {
         robot->self->x = robot->receive_buffer->x;
@@ -57,35 +77,102 @@ void* moveRobot(void* robot_void) {
     }
 }
 
-/// make the robot move to the next position as specified in it's buffer
-void moveRobots(Robot* robots, size_t k) {
-    pthread_t* threadpool = safemalloc(k * sizeof *threadpool);
-    for (int i = 0; i < k; i++) {
-        int code = pthread_create(&threadpool[i], NULL, &moveRobot, robots[i]);
+/// argument of a movement worker
+typedef struct move_worker {
+    MoveBatch batch;
+    size_t first;   // index of the first robot handled by the worker
+} MoveWorker;
+
+/// wait for the move orders of every {n_threads}-th robot and move them
+void* moveWorker(void* worker_void) {
+    MoveWorker* worker = (MoveWorker*) worker_void;
+    MoveBatch batch = worker->batch;
+    for (size_t i = worker->first; i < batch->k; i += batch->n_threads) {
+        Robot robot = batch->robots[i];
+
+        // robots consume their mailbox in order until the move order arrives
+        Message msg;
+        do {
+            msg = awaitMessage(robot->inbox);
+        } while (msg.type != MSG_MOVE);
+        robot->receive_buffer->x = msg.x;
+        robot->receive_buffer->y = msg.y;
+        moveRobot(robot);
+    }
+    safefree(worker);
+    return NULL;
+}
+
+/// start the movement workers of a round
+MoveBatch startMoveRobots(Robot* robots, size_t k, Spatial spatial) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    MoveBatch batch = safemalloc(sizeof *batch, MEM_ROBOTS);
+    batch->robots    = robots;
+    batch->k         = k;
+    batch->spatial   = spatial;
+    batch->n_threads = (cores > 0 && (size_t) cores < k) ? (size_t) cores : k;
+    batch->threads   = safemalloc(batch->n_threads * sizeof *(batch->threads), MEM_ROBOTS);
+    for (size_t t = 0; t < batch->n_threads; t++) {
+        MoveWorker* worker = safemalloc(sizeof *worker, MEM_ROBOTS);
+        worker->batch = batch;
+        worker->first = t;
+        int code = pthread_create(&batch->threads[t], NULL, &moveWorker, worker);
         if (code) {
             printf("Thread creation failed!");
             exit(code);
         };
     }
-    for (size_t t=0; t < k; t++) {
-        pthread_join(threadpool[t], NULL);
+    return batch;
+}
+
+/// update the places of robots which moved in the spatial hash and report robots sharing a cell
+static void relinkRobots(Robot* robots, size_t k, Spatial spatial) {
+    // moves are applied to the spatial hash serially, once all robots stand still
+    for (size_t i=0; i < k; i++) {
+        spatialUpdate(spatial, robots[i]->ID);
     }
-    free(threadpool);
+    size_t* found = safemalloc(spatial->k * sizeof *found, MEM_ROBOTS);
+    for (size_t i=0; i < k; i++) {
+        Robot robot = robots[i];
+        size_t n = spatialQuery(spatial, robot->self->x, robot->self->y, 0, found);
+        for (size_t j=0; j < n; j++) {
+            if (found[j] != robot->ID) {
+                log_error("Robots %zu and %zu collided at (%d, %d)\n", robot->ID, found[j],
+                          robot->self->x, robot->self->y);
+            }
+        }
+    }
+    safefree(found);
+}
+
+/// wait for the movement workers of a round
+void joinMoveRobots(MoveBatch batch) {
+    for (size_t t=0; t < batch->n_threads; t++) {
+        pthread_join(batch->threads[t], NULL);
+    }
+    relinkRobots(batch->robots, batch->k, batch->spatial);
+    safefree(batch->threads);
+    safefree(batch);
 }
 
-/// find the closest unknown position on the grid
-Position getFirstUnknown(Position cur, bool** known, size_t l, size_t b) {
+/// find the closest unknown position on the grid, walking a square spiral outwards from {cur}
+/// @returns a copy of {cur} if every cell is known
+Position getFirstUnknown(Position cur, const bool* known, size_t l, size_t b) {
     // (di, dj) is a vector - direction in which we move right now
-    int di = 1; int dj = 0; int segment_length = 1;
-
-    // current position (i, j) and how much of current segment we passed
-    int i = cur->x; int j = cur->y; int segment_passed = 0;
-    for (int k = 0; k < l*b*4; ++k) {
-        if (i<b && j<l) {   // only if the point on spiral is within bounds
-            // if an unknown is found break
-            if(!known[i][j]) {
-                break;
-            }
+    int di = 1; int dj = 0; size_t segment_length = 1;
+
+    // current position (i, j) and how much of current segment we passed;
+    // once a segment is longer than both sides the spiral has gone around the whole grid
+    int i = cur->x; int j = cur->y; size_t segment_passed = 0;
+    size_t longest = 2 * (l > b ? l : b) + 1;
+    Position pos = safemalloc(sizeof *pos, MEM_PLANNING);
+    *pos = *cur;
+    while (segment_length <= longest) {
+        // only if the point on spiral is within bounds, if an unknown is found stop
+        if (i >= 0 && j >= 0 && (size_t) i < b && (size_t) j < l && !known[cellAt(i, j, b)]) {
+            pos->x = (Coord) i;
+            pos->y = (Coord) j;
+            break;
         }
         // make a step, add 'direction' vector (di, dj) to current position (i, j)
         i += di; j += dj; ++segment_passed;
@@ -102,23 +189,23 @@ Position getFirstUnknown(Position cur, bool** known, size_t l, size_t b) {
             }
         }
     }
-
-    // create the pos object and return it
-    Position pos = safemalloc(sizeof *pos);
-    pos->x = i;
-    pos->y = j;
     return pos;
 }
 
 /// leader robot assigns positions for all robots to go to during the attack phase
-void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, size_t o_size, size_t l, size_t b) {
-    // for every malicious robot assign a phony assignment
+void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, size_t o_size, size_t l, size_t b,
+                     Landmarks landmarks) {
+    // for every robot found to be malicious assign a phony assignment
     int x = (leader->target->x > (b/2) ? 0 : (int) b-1);
     int y = (leader->target->y > (l/2) ? 0 : (int) l-1);
     int count = 0;
     for (int j=0; j<k; j++) {
-        if (robots[j]->malicious) {
-            robots[j]->assignment = safemalloc(sizeof *(robots[j]->assignment));
+        if (robots[j]->crashed) {
+            // a crashed robot can only hold the position it is at
+            robots[j]->assignment = safemalloc(sizeof *(robots[j]->assignment), MEM_PLANNING);
+            *robots[j]->assignment = *robots[j]->self;
+        } else if (robots[j]->suspected) {
+            robots[j]->assignment = safemalloc(sizeof *(robots[j]->assignment), MEM_PLANNING);
             robots[j]->assignment->x = x;
             robots[j]->assignment->y = y;
 
@@ -134,24 +221,25 @@ void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, s
     }
 
     // boolean mapping of positions taken
-    bool **filled = safemalloc(l*b*sizeof *filled);
-    for (int i=0;i<b;i++) {
-        filled[i] = calloc(sizeof **filled, l);
-        for (int j=0;j<l;j++) {
-            filled[i][j] = false;
+    bool* filled = safecalloc(l*b, sizeof *filled, MEM_PLANNING);
+    filled[cellAt(leader->target->x, leader->target->y, b)] = true;
+    int needed = (int) k;  // positions to generate, crashed robots keep theirs
+    for (int j=0; j<k; j++) {
+        if (robots[j]->crashed) {
+            filled[cellAt(robots[j]->self->x, robots[j]->self->y, b)] = true;
+            needed--;
         }
     }
-    filled[leader->target->x][leader->target->y] = true;
 
     int phase = 0;
     int dir = 0;
     int numPos = 0;
     //int layer = 1;  // current layer from the target (when surrounding)
-    Position* posList = safemalloc(k * sizeof *posList);
-    while (numPos < k) {
+    Position* posList = safemalloc(k * sizeof *posList, MEM_PLANNING);
+    while (numPos < needed) {
         int currentNum = numPos;
         int currentPhase = phase;
-        Position assignment = safemalloc(sizeof *assignment);
+        Position assignment = safemalloc(sizeof *assignment, MEM_PLANNING);
         switch (phase) {
             case 0: // Handles North, South, East and West
                 switch (dir) {
@@ -235,7 +323,7 @@ void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, s
                 }
                 break;
             case 2: // Handles the second layer onward if applicable
-                free(assignment);
+                safefree(assignment);
                 assignment = getFirstUnknown(leader->target, filled, l, b);
                 numPos++;
                 break;
@@ -250,31 +338,36 @@ void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, s
             dir = 0;
         }
 
-        // check if a new position was made
-        if (currentNum == numPos) {
-            free(assignment);
+        // check if a new position was made, cells of crashed robots are taken already
+        if (currentNum == numPos || filled[cellAt(assignment->x, assignment->y, b)]) {
+            numPos = currentNum;
+            safefree(assignment);
         } else {
             posList[numPos - 1] = assignment;
-            filled[assignment->x][assignment->y] = true;
+            filled[cellAt(assignment->x, assignment->y, b)] = true;
         }
     }
     ////// ^ This code ^ //////////
 
     // assign every non-malicious robot a unique position around the target
-    for (int j=0; j<k; j++) {
+    // the robots are the obstacles of every search, so they are placed once
+    PathSearch search = makePathSearch(landmarks);
+    setPathObstacles(search, objects, o_size);
+    for (int j=0; j<needed; j++) {
         // determine next position to assign
         Position assignment = posList[j];
 
         // for every robot not yet assigned, award the current assignment
-        // to the robot with the shortest path to travel
+        // to the robot with the shortest path to travel;
+        // after the first robot only strictly shorter paths are searched for
         Robot* top_rob   = NULL;
-        size_t path_size = NULL;
+        size_t path_size = 0;
         for (int x=0; x<k; x++) {
             // if the robot is not malicious and assignment is not yet set
             if (robots[x]->assignment == NULL) {
                 // generate the shortest path size
-                size_t s = find_path(objects, o_size, assignment, robots[x]->self, l, b);
-                if (top_rob == NULL || path_size > s && s!=NULL) {
+                size_t s = pathLength(search, robots[x]->self, assignment, top_rob == NULL ? SIZE_MAX : path_size);
+                if (top_rob == NULL || s != 0) {
                     top_rob   = &(robots[x]);
                     path_size = s;
                 }
@@ -285,126 +378,150 @@ void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, s
         if (top_rob != NULL) {
             (*top_rob)->assignment = assignment;
         } else {
-            free(assignment);
+            safefree(assignment);
         }
     }
 
     // free stuff
-    for (int i=0;i<b;i++) {
-        free(filled[i]);
-    }
-    free(filled);
-    free(posList);
+    safefree(filled);
+    safefree(posList);
+    freePathSearch(search);
 }
 
 /// leader robot directs tertiary robots next move
-void directMovement(Robot leader, Robot* robots, size_t k, size_t l, size_t b) {
-
-    // create temporary array of all logical positions to avoid collisions
-    Position* next_positions = safemalloc((k+1)*(sizeof *next_positions));
-    for (int i = 0; i < k; i++) {
-        next_positions[i] = safemalloc(sizeof **next_positions);
-        next_positions[i]->x = robots[i]->self->x;
-        next_positions[i]->y = robots[i]->self->y;
-    }
-
-    // during the exploration phase
-    if(leader->assignment == NULL) {
-        for (int i = 0; i < k; i++) {
-            leader->explored[robots[i]->self->x][robots[i]->self->y] = true;
-            Position unknown = getFirstUnknown(robots[i]->self, leader->explored, l, b);
-            Position pos = shortest_path(next_positions, k, robots[i]->self, unknown, l, b);
-            next_positions[i]->x = pos->x;
-            next_positions[i]->y = pos->y;
-
-            // leader prepares the position to send
-            leader->send_buffer->x = pos->x;
-            leader->send_buffer->y = pos->y;
-
-            // leader tells the robot it's next position
-            robots[i]->receive_buffer->x = leader->send_buffer->x;
-            robots[i]->receive_buffer->y = leader->send_buffer->y;
-
-            free(unknown);
-            free(pos);
+void directMovement(Robot leader, Robot* robots, size_t k, size_t l, size_t b, Neighborhood moves) {
+    Schedule schedule = attackSchedule(leader, robots, k, l, b, moves);
+
+    // leader tells each robot still on its way their next position
+    for (size_t i = 0; i < schedule->n_pending; i++) {
+        Robot robot = schedule->pending[i];
+        struct pos pos = *robot->self;
+
+        // every robot keeps its own incremental search towards its assignment,
+        // which only repairs what changed since the robot was last planned;
+        // robots which could not move are skipped until their surroundings change
+        if (robotAwake(schedule, leader->occupancy, robot)) {
+            if (robot->planner == NULL) {
+                robot->planner = makePlanner(leader->occupancy, robot->assignment->x, robot->assignment->y);
+            }
+            pos = plannerNextStep(robot->planner, robot->self);
+            if (pos.x != robot->self->x || pos.y != robot->self->y) {
+                vacate(leader->occupancy, robot->self->x, robot->self->y);
+                occupy(leader->occupancy, pos.x, pos.y);
+            } else {
+                robotStayed(schedule, leader->occupancy, robot);
+            }
         }
-    }// during the attack phase
-    else {
-        // target is known, add target to object positions
-        next_positions[k] = safemalloc(sizeof **next_positions);
-        next_positions[k]->x = leader->target->x;
-        next_positions[k]->y = leader->target->y;
-
-        // leader tells each robot their next position
-        for (int i = 0; i < k; i++) {
-            Position pos = shortest_path(next_positions, k+1, robots[i]->self, robots[i]->assignment, l, b);
-            next_positions[i]->x = pos->x;
-            next_positions[i]->y = pos->y;
 
-            // leader prepares the position to send
-            leader->send_buffer->x = pos->x;
-            leader->send_buffer->y = pos->y;
+        // leader prepares the position to send
+        leader->send_buffer->x = pos.x;
+        leader->send_buffer->y = pos.y;
 
-            // leader tells the robot it's next position
-            robots[i]->receive_buffer->x = leader->send_buffer->x;
-            robots[i]->receive_buffer->y = leader->send_buffer->y;
+        // leader tells the robot it's next position
+        Message msg = { MSG_MOVE, leader->ID, 0, leader->send_buffer->x, leader->send_buffer->y };
+        sendMessage(robot->inbox, msg);
+    }
+    compactChanges(leader->occupancy);
+}
 
-            free(pos);
+/// argument of an exploration planning worker
+typedef struct plan_worker {
+    Robot* robots;
+    size_t k;
+    Spatial spatial;
+    Landmarks landmarks;
+    size_t first;   // index of the first robot handled by the worker
+    size_t stride;  // number of workers
+} PlanWorker;
+
+/// let every {stride}-th robot pick its next cell from its own map and region
+static void* planWorker(void* worker_void) {
+    PlanWorker* worker = (PlanWorker*) worker_void;
+    size_t* near = safemalloc(worker->k * sizeof *near, MEM_PLANNING);
+    Position* obstacles = safemalloc(worker->k * sizeof *obstacles, MEM_PLANNING);
+    PathSearch search = makePathSearch(worker->landmarks);
+    for (size_t i = worker->first; i < worker->k; i += worker->stride) {
+        Robot robot = worker->robots[i];
+        if (robot->crashed) {
+            *robot->send_buffer = *robot->self;
+            continue;
+        }
+        Position unknown = coverageGoal(robot->coverage, robot, robot->explored);
+        if (unknown == NULL) {
+            unknown = getFirstUnknown(robot->self, robot->explored, worker->landmarks->l, worker->landmarks->b);
         }
 
-        // free stuff
-        for (int i = 0; i <= k; i++) {
-            free(next_positions[i]);
+        // a robot steers around the robots close enough to exchange maps with
+        size_t n = spatialQuery(worker->spatial, robot->self->x, robot->self->y, EXCHANGE_RADIUS, near);
+        for (size_t j = 0; j < n; j++) {
+            obstacles[j] = worker->robots[near[j]]->self;
         }
-        free(next_positions);
+        setPathObstacles(search, obstacles, n);
+        *robot->send_buffer = searchNextStep(search, robot->self, unknown);
+        safefree(unknown);
     }
+    safefree(near);
+    safefree(obstacles);
+    freePathSearch(search);
+    return NULL;
 }
 
-/// Broadcast target location to all other robots
-void broadcastTarget(Robot sender, Robot* robots, size_t k) {
-    for (int i = 0; i < k; i++) {
-        if (robots[i] != sender) {
-            robots[i]->target = sender->target;
+/// robots plan and take their next exploration step
+void moveExplorers(Robot* robots, size_t k, Spatial spatial, Landmarks landmarks) {
+    // every robot proposes its next cell in its send buffer, in parallel
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n_threads = (cores > 0 && (size_t) cores < k) ? (size_t) cores : k;
+    pthread_t* threads = safemalloc(n_threads * sizeof *threads, MEM_PLANNING);
+    PlanWorker* workers = safemalloc(n_threads * sizeof *workers, MEM_PLANNING);
+    for (size_t t = 0; t < n_threads; t++) {
+        workers[t] = (PlanWorker) { robots, k, spatial, landmarks, t, n_threads };
+        int code = pthread_create(&threads[t], NULL, &planWorker, &workers[t]);
+        if (code) {
+            printf("Thread creation failed!");
+            exit(code);
         }
     }
-}
-
-/// elect a leader for the robots using the bully algorithm
-Robot electLeader(Robot* robots, size_t k) {
-    // Loop through array of robots to find the lowest robot ID
-    Robot leader = NULL;
-    for (size_t x=0; x<k; x++) {
-        if (leader == NULL) {
-            leader = robots[x];
-        } else if (robots[x]->ID < leader->ID) {
-            leader = robots[x];
+    for (size_t t = 0; t < n_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    safefree(threads);
+    safefree(workers);
+
+    // occupied cells are never proposed, so robots can only collide by picking the same free cell;
+    // such robots are at most 2 tiles apart and the one with the lowest ID takes the cell
+    size_t* near = safemalloc(k * sizeof *near, MEM_PLANNING);
+    for (size_t i = 0; i < k; i++) {
+        Robot robot = robots[i];
+        *robot->receive_buffer = *robot->send_buffer;
+        size_t n = spatialQuery(spatial, robot->send_buffer->x, robot->send_buffer->y, 1, near);
+        for (size_t j = 0; j < n; j++) {
+            Robot other = robots[near[j]];
+            if (other->ID < robot->ID && other->send_buffer->x == robot->send_buffer->x
+                    && other->send_buffer->y == robot->send_buffer->y) {
+                *robot->receive_buffer = *robot->self;
+            }
         }
     }
-    // Choose that as the leader
-    printf("  Leader is %zu\n", leader->ID);
-    return robots[0];
+    safefree(near);
+    for (size_t i = 0; i < k; i++) {
+        moveRobot(robots[i]);
+    }
+    relinkRobots(robots, k, spatial);
 }
 
-/// All of the robots verify with the leader that they have the correct target
-/// Checks if a robot is evil
-void verifyTarget(Robot* robots, size_t k) {
-    for (int i = 0; i < k; i++) {
-        for (int j = 0; j < k; j++) {
-            if (robots[j] != robots[i]) {
-
-                if (robots[j]->malicious) {
-                    if (robots[i]->malicious) {
-                        printf("Robot %d(m) verified with Robot %d(m)\n", i, j);
-                    } else {
-                        printf("Robot %d found Robot %d to be malicious!\n", i, j);
-                    }
-                } else if (robots[j]->target == robots[i]->target) {
-                    printf("Robot %d verified with Robot %d\n", i, j);
-                } else {
-                    printf("Uh oh, something went wrong!\n");
-                }
-
-            }
+/// create the leader's occupancy grid and schedule on first use
+Schedule attackSchedule(Robot leader, Robot* robots, size_t k, size_t l, size_t b, Neighborhood moves) {
+    // the leader tracks occupied cells across rounds, starting from
+    // the robots' positions and the target
+    if (leader->occupancy == NULL) {
+        leader->occupancy = makeOccupancy(l, b, moves);
+        for (int i = 0; i < k; i++) {
+            occupy(leader->occupancy, robots[i]->self->x, robots[i]->self->y);
         }
+        occupy(leader->occupancy, leader->target->x, leader->target->y);
+    }
+    if (leader->schedule == NULL) {
+        leader->schedule = makeSchedule(robots, k, l, b);
     }
-}
\ No newline at end of file
+    return leader->schedule;
+}
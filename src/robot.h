@@ -3,27 +3,61 @@
 
 #include <glob.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "utils/safemalloc.h"
+#include "messaging.h"
+#include "utils/rng.h"
+#include "grid.h"
+
+struct planner;
+struct occupancy;
+struct schedule;
+struct spatial;
+struct coverage;
+struct delta;
+struct landmarks;
+
+/// number of rounds of position history kept per robot for stall detection
+#define STALL_WINDOW 8
 
 /// basic position structure
 typedef struct pos {
-    int x;
-    int y;
+    Coord x;
+    Coord y;
 } *Position;
 
+/// moves a robot can make in one round, every move takes one round
+typedef enum neighborhood {
+    NEIGHBORHOOD_4 = 4,     // up, down, right and left
+    NEIGHBORHOOD_8 = 8      // and the four diagonals, which may not cut the corner of an occupied cell
+} Neighborhood;
+
 /// Robot object
 typedef struct robot {
     size_t ID;              // unique ID for robot
-    bool** explored;             // 2d array describing positions that are known
+    bool* explored;             // cells the robot knows, indexed y*b+x
     Position self;              // the robot's position
     Position target;            // the known position of the target
     Position assignment;        // the robot's assigned target position
     Position receive_buffer;    // position in the robot's receive buffer
     Position send_buffer;       // position in the robot's send buffer
+    Mailbox inbox;              // the robot's mailbox on the message layer
     bool malicious;         // is the robot malicious?
+    size_t accusations;     // number of robots which found this robot to be malicious
+    bool suspected;         // robot was found to be malicious through consensus
+    bool crashed;           // robot stopped for good, it stays where it is and sends nothing
+    Rng rng;                // the robot's own random stream
+    struct planner* planner;        // incremental path search towards the assignment
+    struct occupancy* occupancy;    // cells the robot knows to be occupied while it leads the attack
+    struct schedule* schedule;      // robots still on their way while the robot leads the attack
+    struct coverage* coverage;      // the robot's region to explore and the partition of its sweep
+    struct delta* delta;            // cells the robot learned since it last shared its map
+    struct pos history[STALL_WINDOW];   // latest positions during the attack phase, a ring
+    size_t n_history;                   // positions recorded since the history was last cleared
 } *Robot;
 
 /// create a new robot in dynamically allocated space
+/// {pos} is owned by the caller and must outlive the robot
 Robot makeRobot(size_t ID, Position pos, bool malicious, size_t l, size_t b);
 
 /// free a robot from the chains of life
@@ -31,25 +65,39 @@ void freeRobot(Robot robot, size_t l, size_t b);
 
 /// the leader robot assigns positions around the target for all robots
 /// this function is used only during the transition phase
-void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, size_t o_size, size_t l, size_t b);
+/// path lengths are searched with A* bounded by the {landmarks} of the grid
+void assignPositions(Robot leader, Robot* robots, size_t k, Position* objects, size_t o_size, size_t l, size_t b,
+                     struct landmarks* landmarks);
 
 /// the leader robot instructs each robot with the tile to move to in the next movement turn
-/// this function is used by the elected leader during both the exploration and attack phase
-void directMovement(Robot leader, Robot* robots, size_t k, size_t l, size_t b);
+/// this function is used by the elected leader during the attack phase,
+/// only the robots pending in the leader's schedule receive orders
+void directMovement(Robot leader, Robot* robots, size_t k, size_t l, size_t b, Neighborhood moves);
+
+/// every robot picks its next cell of the exploration from its own map and region, steering
+/// around the robots near it, then all robots move; planning runs in parallel using pthreads
+/// robots which picked the same cell leave it to the one with the lowest ID
+void moveExplorers(Robot* robots, size_t k, struct spatial* spatial, struct landmarks* landmarks);
 
-/// move robots to the position in their receive_buffer (if valid)
-/// robots move in parallel using pthreads
-void moveRobots(Robot* robots, size_t k);
+/// the leader's schedule of the attack phase, created together with its occupancy grid on first use
+struct schedule* attackSchedule(Robot leader, Robot* robots, size_t k, size_t l, size_t b, Neighborhood moves);
 
-/// have a robot broadcast it's target to all other robots
-void broadcastTarget(Robot sender, Robot* robots, size_t k);
+/// workers which move robots while the leader is still directing the round
+typedef struct move_batch {
+    pthread_t* threads;
+    size_t n_threads;
+    Robot* robots;
+    size_t k;
+    struct spatial* spatial;
+} *MoveBatch;
 
-/// elect a leader for the robots using the bully algorithm
-/// the robot with the lowest ID is elected leader
-Robot electLeader(Robot* robots, size_t k);
+/// start moving robots for the current round
+/// each robot waits for the leader's move order in its mailbox, loads it into
+/// its receive_buffer and moves there (if valid); robots move in parallel using pthreads
+MoveBatch startMoveRobots(Robot* robots, size_t k, struct spatial* spatial);
 
-/// All of the robots verify through consensus that they have the correct target
-/// this function is also used to identify malicious robots
-void verifyTarget(Robot* robots, size_t k);
+/// wait until every robot of the batch has received its order and moved,
+/// then update the robots' places in the spatial hash and report robots sharing a cell
+void joinMoveRobots(MoveBatch batch);
 
 #endif //CSCI251_PROJECT3_ROBOT_H
@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include "utils/log.h"
+#include "scheduling.h"
+#include "pathfinding.h"
+
+/// whether the robot stands on its assignment
+static bool onAssignment(Robot robot) {
+    return robot->self->x == robot->assignment->x && robot->self->y == robot->assignment->y;
+}
+
+/// whether the robot at {pos} has no cell it can move to
+static bool boxedIn(Occupancy occ, const struct pos* pos) {
+    Cell nbrs[8];
+    Cell cell = cellAt(pos->x, pos->y, occ->b);
+    return gridMoves(occ->blocked, occ->l, occ->b, occ->moves, cell, nbrs) == 0;
+}
+
+/// create a schedule
+Schedule makeSchedule(Robot* robots, size_t k, size_t l, size_t b) {
+    Schedule schedule = safemalloc(sizeof *schedule, MEM_PLANNING);
+    schedule->k         = k;
+    schedule->robots    = robots;
+    schedule->pending   = safemalloc(k * sizeof *(schedule->pending), MEM_PLANNING);
+    schedule->reasons   = safecalloc(k, sizeof *(schedule->reasons), MEM_PLANNING);
+    schedule->freed     = safecalloc(k, sizeof *(schedule->freed), MEM_PLANNING);
+    schedule->cells     = l * b;
+    schedule->taken     = safecalloc(l * b, sizeof *(schedule->taken), MEM_PLANNING);
+    schedule->seen      = safecalloc(l * b, sizeof *(schedule->seen), MEM_PLANNING);
+    schedule->searches  = 0;
+    schedule->queue     = safemalloc(l * b * sizeof *(schedule->queue), MEM_PLANNING);
+    schedule->n_pending = 0;
+    for (size_t i=0; i<k; i++) {
+        if (!onAssignment(robots[i])) {
+            schedule->pending[schedule->n_pending++] = robots[i];
+        }
+        schedule->taken[cellAt(robots[i]->assignment->x, robots[i]->assignment->y, b)]++;
+    }
+    schedule->settled = k - schedule->n_pending;
+    return schedule;
+}
+
+/// free a schedule
+void freeSchedule(Schedule schedule) {
+    safefree(schedule->pending);
+    safefree(schedule->reasons);
+    safefree(schedule->freed);
+    safefree(schedule->taken);
+    safefree(schedule->seen);
+    safefree(schedule->queue);
+    safefree(schedule);
+}
+
+/// start a search over the grid, no cell has been seen by it yet
+static void newSearch(Schedule schedule) {
+    if (++schedule->searches == 0) {
+        memset(schedule->seen, 0, schedule->cells * sizeof *(schedule->seen));
+        schedule->searches = 1;
+    }
+}
+
+/// mark a cell as seen by the current search, returns false if it already was
+static bool visit(Schedule schedule, Cell cell) {
+    if (schedule->seen[cell] == schedule->searches) {
+        return false;
+    }
+    schedule->seen[cell] = schedule->searches;
+    return true;
+}
+
+/// move the robot's assignment to {x}, {y}, keeping the taken cells up to date
+static void assign(Schedule schedule, Occupancy occ, Robot robot, Coord x, Coord y) {
+    schedule->taken[cellAt(robot->assignment->x, robot->assignment->y, occ->b)]--;
+    schedule->taken[cellAt(x, y, occ->b)]++;
+    robot->assignment->x = x;
+    robot->assignment->y = y;
+}
+
+/// check whether a robot has to be planned
+bool robotAwake(Schedule schedule, Occupancy occ, Robot robot) {
+    switch (schedule->reasons[robot->ID]) {
+        case WAIT_NEIGHBORS:
+            // only a free neighbor gives the robot somewhere to go
+            if (boxedIn(occ, robot->self)) {
+                return false;
+            }
+            break;
+        case WAIT_FREED:
+            // more blocked cells can never open a path which did not exist
+            if (occ->n_freed == schedule->freed[robot->ID]) {
+                return false;
+            }
+            break;
+        default:
+            break;
+    }
+    schedule->reasons[robot->ID] = WAIT_NONE;
+    return true;
+}
+
+/// put a robot to sleep
+void robotStayed(Schedule schedule, Occupancy occ, Robot robot) {
+    if (onAssignment(robot)) {
+        return;
+    }
+    schedule->reasons[robot->ID] = boxedIn(occ, robot->self) ? WAIT_NEIGHBORS : WAIT_FREED;
+    schedule->freed[robot->ID]   = occ->n_freed;
+}
+
+/// compact the pending robots, settled robots never plan again
+void settleRobots(Schedule schedule) {
+    size_t n = 0;
+    for (size_t i=0; i<schedule->n_pending; i++) {
+        Robot robot = schedule->pending[i];
+        if (!onAssignment(robot)) {
+            schedule->pending[n++] = robot;
+        } else if (robot->planner != NULL) {
+            freePlanner(robot->planner);
+            robot->planner = NULL;
+        }
+    }
+    schedule->settled  += schedule->n_pending - n;
+    schedule->n_pending = n;
+}
+
+/// whether the robot covered at most two cells in its whole history window
+static bool stalled(Robot robot) {
+    if (robot->n_history < STALL_WINDOW) {
+        return false;
+    }
+    struct pos first = robot->history[0], second = first;
+    for (size_t i=1; i<STALL_WINDOW; i++) {
+        struct pos p = robot->history[i];
+        if (p.x == first.x && p.y == first.y) {
+            continue;
+        }
+        if (second.x == first.x && second.y == first.y) {
+            second = p;
+        } else if (p.x != second.x || p.y != second.y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// forget the robot's search and history after its assignment changed
+static void restart(Schedule schedule, Robot robot) {
+    if (robot->planner != NULL) {
+        freePlanner(robot->planner);
+        robot->planner = NULL;
+    }
+    robot->n_history = 0;
+    schedule->reasons[robot->ID] = WAIT_NONE;
+}
+
+/// make the robot hold its current position
+static void yield(Schedule schedule, Occupancy occ, Robot robot) {
+    assign(schedule, occ, robot, robot->self->x, robot->self->y);
+}
+
+/// find the pending robot standing on the stalled robot's assignment
+static Robot blocker(Schedule schedule, Robot robot) {
+    for (size_t i=0; i<schedule->n_pending; i++) {
+        Robot other = schedule->pending[i];
+        if (other->self->x == robot->assignment->x && other->self->y == robot->assignment->y) {
+            return other;
+        }
+    }
+    return NULL;
+}
+
+/// give the robot the free cell closest to the target which it can reach
+/// and no other robot is assigned to, or make it hold its position if there is none
+static void reassign(Schedule schedule, Occupancy occ, Robot robot, Position target) {
+    Cell own = cellAt(robot->assignment->x, robot->assignment->y, occ->b);
+
+    // breadth-first over free cells, starting from the robot's own (occupied) cell
+    Cell start = cellAt(robot->self->x, robot->self->y, occ->b);
+    Cell best = start;
+    Cell* queue = schedule->queue;
+    size_t head = 0, tail = 0;
+    long best_dist = -1;
+    newSearch(schedule);
+    visit(schedule, start);
+    queue[tail++] = start;
+    while (head < tail) {
+        Cell cell = queue[head++];
+        size_t x = cell % occ->b, y = cell / occ->b;
+        long dist = (long) gridDistance(occ->moves, (int) x, (int) y, target->x, target->y);
+        bool taken = schedule->taken[cell] > (cell == own ? 1u : 0u);
+        if (cell != start && !taken && (best_dist < 0 || dist < best_dist)) {
+            best_dist = dist;
+            best      = cell;
+        }
+        Cell nbrs[8];
+        int n = gridMoves(occ->blocked, occ->l, occ->b, occ->moves, cell, nbrs);
+        for (int i=0; i<n; i++) {
+            if (visit(schedule, nbrs[i])) {
+                queue[tail++] = nbrs[i];
+            }
+        }
+    }
+    assign(schedule, occ, robot, (Coord) (best % occ->b), (Coord) (best / occ->b));
+}
+
+/// detect and resolve stalled robots
+size_t resolveStalls(Schedule schedule, Occupancy occ, Position target, StallStrategy strategy) {
+    size_t n_stalled = 0;
+    for (size_t i=0; i<schedule->n_pending; i++) {
+        Robot robot = schedule->pending[i];
+        robot->history[robot->n_history++ % STALL_WINDOW] = *robot->self;
+        if (!stalled(robot)) {
+            continue;
+        }
+        n_stalled++;
+        log_debug("  Robot %zu stalled at (%d, %d) on its way to (%d, %d)\n", robot->ID,
+                  robot->self->x, robot->self->y, robot->assignment->x, robot->assignment->y);
+
+        Robot other = strategy == STALL_SWAP ? blocker(schedule, robot) : NULL;
+        if (other != NULL) {
+            struct pos swap    = *robot->assignment;
+            *robot->assignment = *other->assignment;
+            *other->assignment = swap;
+            restart(schedule, other);
+        } else if (strategy == STALL_YIELD) {
+            yield(schedule, occ, robot);
+        } else {
+            reassign(schedule, occ, robot, target);
+        }
+        restart(schedule, robot);
+    }
+    if (n_stalled > 0) {
+        settleRobots(schedule);
+    }
+    return n_stalled;
+}
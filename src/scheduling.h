@@ -0,0 +1,57 @@
+#ifndef CSCI251_PROJECT3_SCHEDULING_H
+#define CSCI251_PROJECT3_SCHEDULING_H
+
+#include <glob.h>
+#include "robot.h"
+#include "simulation.h"
+#include "replanning.h"
+
+/// why a pending robot is not planned this round
+typedef enum wait_reason {
+    WAIT_NONE,          // plan the robot
+    WAIT_NEIGHBORS,     // boxed in, wake once a neighboring cell is free
+    WAIT_FREED          // goal unreachable, wake once any cell became free
+} WaitReason;
+
+/// robots of the attack phase which have not reached their assignment yet
+/// a settled robot never moves again and is dropped for good; a robot which could not
+/// move sleeps until the occupancy changes in a way that could let it move
+typedef struct schedule {
+    Robot* robots;          // every robot, indexed by ID
+    Robot* pending;         // unsettled robots in ID order
+    size_t n_pending;
+    size_t settled;         // number of robots on their assignment
+    size_t k;
+    WaitReason* reasons;    // per robot ID
+    size_t* freed;          // per robot ID, occupancy frees seen when the robot went to sleep
+    uint32_t* taken;        // per cell, number of robots assigned to it
+    uint32_t* seen;         // per cell, the search which last reached it
+    uint32_t searches;      // number of searches run over the grid
+    Cell* queue;            // breadth-first queue shared by the searches, one slot per cell
+    size_t cells;
+} *Schedule;
+
+/// create the schedule of {robots} on an {l} by {b} grid, every robot not on its assignment is pending
+Schedule makeSchedule(Robot* robots, size_t k, size_t l, size_t b);
+
+/// free a schedule
+void freeSchedule(Schedule schedule);
+
+/// whether the pending {robot} has to be planned now
+/// a sleeping robot wakes up (and stays awake) once the cells it waits on changed
+bool robotAwake(Schedule schedule, Occupancy occ, Robot robot);
+
+/// put {robot} to sleep after planning left it where it is
+void robotStayed(Schedule schedule, Occupancy occ, Robot robot);
+
+/// drop the robots which reached their assignment this round, together with their planners
+void settleRobots(Schedule schedule);
+
+/// record the position of every pending robot and resolve the robots which stalled,
+/// i.e. only covered one or two cells (standing still or oscillating) in the last STALL_WINDOW rounds
+/// robots whose assignment changed are re-planned from scratch and may settle immediately
+/// @param target the target, which reassigned robots are kept close to
+/// @returns the number of stalled robots
+size_t resolveStalls(Schedule schedule, Occupancy occ, Position target, StallStrategy strategy);
+
+#endif //CSCI251_PROJECT3_SCHEDULING_H
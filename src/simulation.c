@@ -1,214 +1,471 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
-#include "simulation.h"
-#include "utils/display.h"
+#include "simulation_internal.h"
+#include "agreement.h"
+#include "scheduling.h"
+#include "spatial.h"
+#include "mapping.h"
+#include "election.h"
+#include "pathfinding.h"
+#include "utils/log.h"
 
-/// seed the random number generator
-void seed(long seed)  {
-    // get a true random number
-    srand(seed); // seed rand
+/// one displaced entry of the virtual cell permutation used by placeObjects
+typedef struct swap {
+    size_t cell;        // index into the permutation
+    size_t value;       // cell currently stored at that index
+    bool used;
+} Swap;
+
+/// find the permutation entry of a cell, creating it if it was never displaced
+Swap* lookupSwap(Swap* swaps, size_t mask, size_t cell) {
+    size_t h = (cell * 0x9e3779b97f4a7c15ULL) & mask;
+    while (swaps[h].used && swaps[h].cell != cell) {
+        h = (h+1) & mask;
+    }
+    if (!swaps[h].used) {
+        swaps[h].used  = true;
+        swaps[h].cell  = cell;
+        swaps[h].value = cell;
+    }
+    return &swaps[h];
 }
 
-/// generate a random position available on the simulation grid
-Position newPos(size_t l, size_t b, size_t k, Position* objects) {
-    Position pos = safemalloc(sizeof *pos);
-    pos->x = (int) (rand() % b);
-    pos->y = (int) (rand() % l);
+/// place {count} distinct random positions on the simulation grid into {positions}
+/// draws from a sparse Fisher-Yates shuffle of the cell indices,
+/// so each position takes one random number however crowded the grid is
+void placeObjects(size_t l, size_t b, size_t count, Rng* rng, struct pos* positions) {
+    size_t cells = l*b;
+    size_t cap = 1;
+    while (cap < 4*count) {
+        cap <<= 1;
+    }
+    Swap* swaps = safecalloc(cap, sizeof *swaps, MEM_SIMULATION);
 
-    // make sure that the new coordinate is not already occupied
-    for(size_t j=0; j<k; j++) {
-        // exhausted occupied list
-        if (objects[j]==NULL) {
-            break;
-        } // found collision
-        else if ((objects[j]->x==pos->x) && (objects[j]->y==pos->y)) {
-            free(pos);                        // free the old position
-            pos = newPos(l, b, k, objects);   // try again with new position
-        }
+    for (size_t j=0; j<count; j++) {
+        // swap a random remaining cell into slot j
+        size_t r = j + (size_t) rng_below(rng, cells - j);
+        Swap* at_r = lookupSwap(swaps, cap-1, r);
+        Swap* at_j = lookupSwap(swaps, cap-1, j);
+        size_t cell = at_r->value;
+        at_r->value = at_j->value;
+        at_j->value = cell;
+
+        positions[j].x = (Coord) (cell % b);
+        positions[j].y = (Coord) (cell / b);
     }
-    return pos;
+    safefree(swaps);
 }
 
 /// do one turn of the exploration stage
 /// @returns true if the exploration stage has completed
-bool explore(Robot* robots, Robot leader, Position target, size_t k, Position* objects, size_t o_size, size_t l, size_t b) {
-    // For each robot, check if they found the target
-    printf("  Target is at (%d, %d)\n", target->x, target->y);
+bool explore(Robot* robots, Position target, size_t k, Spatial spatial, Exchange exchange, size_t l, size_t b,
+             Landmarks landmarks) {
+    log_debug("  Target is at (%d, %d)\n", target->x, target->y);
     for (int i = 0; i < k; i++) {
-        printf("  Robot %d is at (%d, %d)\n", i, robots[i]->self->x, robots[i]->self->y);
+        log_debug("  Robot %d is at (%d, %d)\n", i, robots[i]->self->x, robots[i]->self->y);
+    }
 
-        // if the robot is within 1 tile of the target, robot 'sees' the target
-        if (abs(robots[i]->self->x - target->x) <= 1 &&
-                abs(robots[i]->self->y - target->y) <= 1) {
-            printf("Robot #%d found the target!\n", i);
+    // robots within 1 tile of the target 'see' the target, the one with the lowest ID reports it;
+    // malicious robots keep their sightings to themselves
+    size_t* near = safemalloc(k * sizeof *near, MEM_SIMULATION);
+    size_t n_near = spatialQuery(spatial, target->x, target->y, 1, near);
+    size_t finder = NO_ROBOT;
+    for (size_t j = 0; j < n_near; j++) {
+        if (!robots[near[j]]->malicious && !robots[near[j]]->crashed && near[j] < finder) {
+            finder = near[j];
+        }
+    }
+    safefree(near);
 
-            // Set the target of the robot next to target
-            robots[i]->target = target;
-            Robot sender = robots[i];
+    if (finder != NO_ROBOT) {
+        log_info("Robot #%zu found the target!\n", finder);
 
-            // Broadcast that target to every robot
-            printf("Broadcasting location to all robots...\n");
-            broadcastTarget(sender, robots, k);
+        // Set the target of the robot next to target
+        Robot sender = robots[finder];
+        sender->target = safemalloc(sizeof *(sender->target), MEM_ROBOTS);
+        sender->target->x = target->x;
+        sender->target->y = target->y;
 
-            // The robots verify with all the other robots that they all have the same target
-            printf("Verifying target with all robots...\n");
-            verifyTarget(robots, k);
-            return true;
-        }
-    }
+        // Broadcast that target to every robot
+        log_info("Broadcasting location to all robots...\n");
+        broadcastTarget(sender, robots, k);
 
-    // leader tells robots which position they should move to next
-    directMovement(leader, robots, k, l, b);
+        // The robots verify with all the other robots that they all have the same target
+        log_info("Verifying target with all robots...\n");
+        AgreementStats stats = verifyTarget(robots, k);
+        log_info("%zu robots agreed on target (%d, %d) in %d rounds (%llu messages, %llu bytes)\n",
+               stats.delivered, stats.x, stats.y, stats.rounds, stats.messages, stats.bytes);
+        return true;
+    }
 
-    // robots move to their positions in parallel
-    moveRobots(robots, k);
+    // robots map their surroundings, share what they learned with the robots near them
+    // and each plans its own next step from what it knows
+    exchangeMaps(exchange, robots, spatial, l, b);
+    moveExplorers(robots, k, spatial, landmarks);
 
     return false;
 }
 
 /// do one turn of the exploration stage
 /// @returns void
-void transition(Robot* robots, Robot leader, size_t k, Position* objects, size_t o_size, size_t l, size_t b) {
+void transition(Robot* robots, Robot leader, size_t k, Position* objects, size_t o_size, size_t l, size_t b,
+                Landmarks landmarks) {
     // print out robot's targets
     for (int i = 0; i < k; i++) {
-        printf("  Robot %d believes that the target is at (%d, %d)\n", i,
+        log_debug("  Robot %d believes that the target is at (%d, %d)\n", i,
                robots[i]->target->x, robots[i]->target->y);
     }
 
     // assign positions around the target for each robot
     // choices are based on ID of robot rather than optimal path lengths
-    assignPositions(leader, robots, k, objects, o_size, l, b);
+    assignPositions(leader, robots, k, objects, o_size, l, b, landmarks);
 
     // print out assignments for each robot
     for (int i = 0; i < k; i++) {
         if(robots[i]->assignment != NULL) {
-            printf("  Robot %d's assigned spot is (%d, %d)\n", i,
+            log_debug("  Robot %d's assigned spot is (%d, %d)\n", i,
                    robots[i]->assignment->x, robots[i]->assignment->y);
         }
     }
 }
 
 /// do one turn of the attack stage
+/// @param stalls set to the number of robots which stalled this turn
 /// @returns true if the attack stage has completed
-bool attack(Robot* robots, Robot leader, size_t k, size_t l, size_t b) {
+bool attack(Robot* robots, Robot leader, size_t k, Spatial spatial, size_t l, size_t b, Neighborhood moves,
+            StallStrategy strategy, size_t* stalls) {
     // print robot positions
     for (int i = 0; i < k; i++) {
-        printf("  Robot %d is at (%d, %d)\n", i, robots[i]->self->x, robots[i]->self->y);
+        log_debug("  Robot %d is at (%d, %d)\n", i, robots[i]->self->x, robots[i]->self->y);
     }
 
-    // leader tells robots which position they should move to next
-    directMovement(leader, robots, k, l, b);
+    // robots still on their way wait for their orders and move to their positions
+    // in parallel, while the leader tells them which position they should move to next
+    Schedule schedule = attackSchedule(leader, robots, k, l, b, moves);
+    MoveBatch batch = startMoveRobots(schedule->pending, schedule->n_pending, spatial);
+    directMovement(leader, robots, k, l, b, moves);
+    joinMoveRobots(batch);
 
-    // robots move to their positions in parallel
-    moveRobots(robots, k);
+    // the attack stage is done once all robots are in their assigned positions,
+    // robots which stopped making progress are given a different assignment
+    settleRobots(schedule);
+    *stalls = resolveStalls(schedule, leader->occupancy, leader->target, strategy);
+    return schedule->settled == k;
+}
 
-    // check if robots are in their assigned positions
-    for (int i = 0; i < k; i++) {
-        if (robots[i]->self->x != robots[i]->assignment->x ||
-                robots[i]->self->y != robots[i]->assignment->y) {
-            return false;   // attack stage is not yet finished
-        }
+/// hold an election and make the winner lead
+static void elect(Simulation sim) {
+    ElectionStats stats = electLeader(sim->robots, sim->k);
+    sim->elections++;
+    sim->election_rounds   += stats.rounds;
+    sim->election_messages += stats.messages;
+    if (stats.leader == NO_ROBOT) {
+        log_error("No robot is left to lead\n");
+        return;
+    }
+    log_info("Robot %zu elected leader in %d rounds (%llu messages)\n", stats.leader, stats.rounds, stats.messages);
+
+    Robot old = sim->leader;
+    sim->leader       = sim->robots[stats.leader];
+    sim->silent_turns = 0;
+    if (old != NULL && old != sim->leader) {
+        handOverLeadership(old, sim->robots, sim->k);
+    }
+}
+
+/// the leader multicasts a heartbeat every turn, the robots elect a new leader once
+/// the leader was found to be malicious or they missed HEARTBEAT_TIMEOUT heartbeats in a row
+static void superviseLeader(Simulation sim) {
+    sendHeartbeat(sim->leader);
+    if (heardHeartbeat(sim->net, sim->leader->ID)) {
+        sim->silent_turns = 0;
+    } else {
+        sim->silent_turns++;
+    }
+
+    if (sim->leader->suspected) {
+        log_info("Leader %zu was found to be malicious, electing a new leader...\n", sim->leader->ID);
+    } else if (sim->silent_turns >= HEARTBEAT_TIMEOUT) {
+        log_info("Leader %zu missed %d heartbeats, electing a new leader...\n", sim->leader->ID, sim->silent_turns);
+    } else {
+        return;
     }
-    return true;    // all robots in assigned positions, attack stage done
+    elect(sim);
 }
 
-/// run the simulation
-/// @returns the simulation's exit code
-int run(size_t l, size_t b, size_t k, size_t e, long s) {
+/// create a simulation with freshly placed target and robots
+Simulation makeSimulation(size_t l, size_t b, size_t k, size_t e, long s) {
     assert(l>0 && b>0 && k>0);  // l & b & k must be nonzero
     assert(k > (3*e)+1 || k==1);// k must be greater than 3*e+1
     assert(k < l*b);            // k must be less than the total number of free spaces
-    seed(s);                    // seed random
+    if (!gridFits(l, b)) {      // every cell must be addressable with the compiled index width
+        printf("A %zux%zu grid does not fit %d-bit cell indices, rebuild with -DGRID_INDEX_BITS=64\n",
+               l, b, GRID_INDEX_BITS);
+        exit(EXIT_FAILURE);
+    }
+
+    Simulation sim = safemalloc(sizeof *sim, MEM_SIMULATION);
+    sim->l = l; sim->b = b; sim->k = k; sim->e = e; sim->s = s;
+    sim->phase = PHASE_EXPLORE;
+    sim->round = 0;
 
     /** Initialize target location and robots **/
-    // array of positions on the grid which have been taken
-    Position* objects = safecalloc(sizeof *(objects), k+1);
-    size_t o_size  = 0;
-
-    // determine position for the target
-    Position target  = newPos(l, b, k, objects);
-    objects[o_size] = target;      // add target pos to occupied list
-    o_size++;
-
-    // initialize all robots
-    Robot* robots = safemalloc((sizeof *robots) * k);  // space for k pointers
-    for(size_t j=0; j<k-e; j++) {                      // make good robots
-        Position pos    = newPos(l, b, k, objects);
-        robots[j]       = makeRobot(j, pos, false, l, b);
-        objects[o_size] = pos;
-        o_size++;
-    }
-    for(size_t j=k-e; j<k; j++) {                      // make bad robots
-        Position pos    = newPos(l, b, k, objects);
-        robots[j]       = makeRobot(j, pos, true, l, b);
-        objects[o_size] = pos;
-        o_size++;
-    }
-
-    // set the initial display setup
-    update_display(l, b, k, 0, 0, robots, target);
-
-    /** Begin the simulation loop **/
-    int* phase = safecalloc(1, sizeof *phase);
-    int round  = 0;
-    Robot leader = electLeader(robots, k);
-    while(*phase >= 0) {    // each loop is a turn in the simulation
-        // Elect leader
-        switch (*phase)
-        {
-            case 0:     // exploration phase
-                if (explore(robots, leader, target, k, objects, o_size, l, b)) {
-                    *phase = 1; // simulation moves to transition/position assignment phase
-                    printf("Entering transition phase...\n");
-                    printf("==============\n");
-                }
-                round++;
-                break;
+    // array of positions on the grid which have been taken,
+    // the target takes the first position and each robot one of the others
+    Rng placement   = rng_stream((uint64_t) s, RNG_PLACEMENT, 0);
+    sim->cells      = safemalloc((k+1) * sizeof *(sim->cells), MEM_SIMULATION);
+    placeObjects(l, b, k+1, &placement, sim->cells);
+    sim->objects    = safemalloc((k+1) * sizeof *(sim->objects), MEM_SIMULATION);
+    for(size_t j=0; j<=k; j++) {
+        sim->objects[j] = &sim->cells[j];
+    }
+    sim->o_size     = k+1;
+    sim->target     = sim->objects[0];
 
-            case 1:     // transition phase
-                transition(robots, leader, k, objects, o_size, l, b);
-                *phase = 2; // simulation moves to the attack phase
-                printf("Entering attack phase...\n");
-                printf("==============\n");
-                break;
+    // initialize all robots, the last {e} robots are malicious
+    sim->robots = safemalloc((sizeof *(sim->robots)) * k, MEM_SIMULATION);  // space for k pointers
+    for(size_t j=0; j<k; j++) {
+        sim->robots[j]      = makeRobot(j, sim->objects[j+1], j >= k-e, l, b);
+        sim->robots[j]->rng = rng_stream((uint64_t) s, RNG_ROBOT, j);
+    }
 
-            case 2:     // attack phase
-                if (attack(robots, leader, k, l, b)) {
-                    *phase = -1; // simulation done
-                };
-                round++;
-                break;
+    // connect every robot to the message layer
+    sim->net = makeNetwork(k, 4);
+    for(size_t j=0; j<k; j++) {
+        sim->robots[j]->inbox = networkMailbox(sim->net, j);
+    }
+
+    // index the robots by position for proximity queries
+    sim->spatial = makeSpatial(&sim->cells[1], k, l, b);
+
+    // robots exchange their maps with the robots near them
+    sim->exchange = makeExchange(k);
+
+    // path searches are bounded by landmarks, placed once the moves are known
+    sim->landmarks = makeLandmarks(l, b);
+
+    // the robots elect their leader over the message layer
+    sim->leader            = NULL;
+    sim->silent_turns      = 0;
+    sim->elections         = 0;
+    sim->election_rounds   = 0;
+    sim->election_messages = 0;
+    elect(sim);
+
+    sim->moves          = NEIGHBORHOOD_8;
+    sim->stall_strategy = STALL_SWAP;
+    sim->max_rounds     = (int) (2*l*b + 2*(l+b));
+    sim->stalls         = 0;
+    sim->timed_out      = false;
+    return sim;
+}
+
+/// the landmarks of the grid, placed again whenever the moves changed or another robot crashed;
+/// crashed robots never move again, so they are the only cells which never become free
+static Landmarks staticLayout(Simulation sim) {
+    size_t crashed = 0;
+    for (size_t j=0; j<sim->k; j++) {
+        crashed += sim->robots[j]->crashed;
+    }
+    Landmarks lm = sim->landmarks;
+    if (lm->moves != sim->moves || lm->n_walls != crashed) {
+        Position* walls = safemalloc((crashed+1) * sizeof *walls, MEM_SIMULATION);
+        size_t n = 0;
+        for (size_t j=0; j<sim->k; j++) {
+            if (sim->robots[j]->crashed) {
+                walls[n++] = sim->robots[j]->self;
+            }
+        }
+        placeLandmarks(lm, sim->moves, walls, n);
+        safefree(walls);
+    }
+    return lm;
+}
+
+/// do one turn of the simulation
+static void stepOnce(Simulation sim) {
+    superviseLeader(sim);
+
+    switch (sim->phase)
+    {
+        case PHASE_EXPLORE:
+            if (explore(sim->robots, sim->target, sim->k, sim->spatial, sim->exchange, sim->l, sim->b, staticLayout(sim))) {
+                sim->phase = PHASE_TRANSITION; // simulation moves to transition/position assignment phase
+                log_info("Entering transition phase...\n");
+                log_info("==============\n");
+            }
+            sim->round++;
+            break;
 
-            default:    // error of some sort?
-                assert(NULL);
+        case PHASE_TRANSITION:
+            // the robots wait for their assignments until they have a leader again
+            if (sim->leader->crashed) {
+                sim->round++;
                 break;
+            }
+            transition(sim->robots, sim->leader, sim->k, sim->objects, sim->o_size, sim->l, sim->b, staticLayout(sim));
+            sim->phase = PHASE_ATTACK; // simulation moves to the attack phase
+            log_info("Entering attack phase...\n");
+            log_info("==============\n");
+            break;
+
+        case PHASE_ATTACK: {
+            // the robots hold their positions while they have no leader to direct them
+            size_t stalls = 0;
+            if (!sim->leader->crashed && attack(sim->robots, sim->leader, sim->k, sim->spatial, sim->l, sim->b, sim->moves,
+                                               sim->stall_strategy, &stalls)) {
+                sim->phase = PHASE_FINISHED; // simulation done
+            }
+            if (stalls > 0) {
+                log_info("  Resolved %zu stalled robots on round %d (seed %ld)\n", stalls, sim->round, sim->s);
+                sim->stalls += stalls;
+            }
+            sim->round++;
+            break;
         }
 
-        /* block until user presses enter */
-        printf("Hit [ENTER] to continue, or (q)uit: ");
-        char* input = NULL; size_t size;
-        getline(&input, &size, stdin);
-        if(input[0]=='q' || input=="quit") *phase = -1;
-        free(input);
+        default:    // error of some sort?
+            assert(NULL);
+            break;
+    }
+
+    // messages are delivered within the round they were sent
+    networkNextRound(sim->net);
 
-        // update display for the next turn
-        update_display(l, b, k, *phase, round, robots, target);
+    // robots which never settle must not keep the simulation running forever
+    if (sim->phase != PHASE_FINISHED && sim->round >= sim->max_rounds) {
+        log_error("Round limit of %d reached before the robots settled (seed %ld)\n", sim->max_rounds, sim->s);
+        sim->phase     = PHASE_FINISHED;
+        sim->timed_out = true;
     }
+}
 
-    // print robot positions
-    printf("Final positions of robots:\n");
-    for (int i = 0; i < k; i++) {
-        printf("  Robot %d is at (%d, %d)\n", i, robots[i]->self->x, robots[i]->self->y);
+/// do up to n turns of the simulation
+int stepSimulation(Simulation sim, int n) {
+    int turns = 0;
+    while (turns < n && sim->phase != PHASE_FINISHED) {
+        stepOnce(sim);
+        turns++;
     }
+    return turns;
+}
 
-    /** Free all initialized variables **/
-    free(phase);
-    free(target);
-    for(size_t j=0; j<k; j++) {
-        freeRobot(robots[j], l, b);
+/// stop a robot for good
+void crashRobot(Simulation sim, size_t id) {
+    Robot robot = sim->robots[id];
+    if (robot->crashed) {
+        return;
+    }
+    robot->crashed = true;
+    log_info("Robot %zu crashed at (%d, %d)\n", id, robot->self->x, robot->self->y);
+
+    // a robot on its way to its assignment stops where it is
+    if (robot->assignment != NULL) {
+        *robot->assignment = *robot->self;
+        if (robot->planner != NULL) {
+            freePlanner(robot->planner);
+            robot->planner = NULL;
+        }
+        if (sim->leader->schedule != NULL) {
+            settleRobots(sim->leader->schedule);
+        }
+    }
+}
+
+/// get the leader's ID
+size_t simulationLeader(Simulation sim) {
+    return sim->leader->ID;
+}
+
+/// configure the moves robots can make
+void setNeighborhood(Simulation sim, Neighborhood moves) {
+    sim->moves = moves;
+}
+
+/// configure stall handling
+void setStallStrategy(Simulation sim, StallStrategy strategy) {
+    sim->stall_strategy = strategy;
+}
+
+/// configure the round limit
+void setRoundLimit(Simulation sim, int max_rounds) {
+    sim->max_rounds = max_rounds;
+}
+
+/// count resolved stalls
+size_t simulationStalls(Simulation sim) {
+    return sim->stalls;
+}
+
+/// check how the simulation finished
+bool simulationTimedOut(Simulation sim) {
+    return sim->timed_out;
+}
+
+/// get the current phase
+int simulationPhase(Simulation sim) {
+    return sim->phase;
+}
+
+/// get the number of rounds done
+int simulationRound(Simulation sim) {
+    return sim->round;
+}
+
+/// get the grid dimensions
+void simulationSize(Simulation sim, size_t* l, size_t* b) {
+    *l = sim->l;
+    *b = sim->b;
+}
+
+/// view the target's position
+const struct pos* targetPosition(Simulation sim) {
+    return sim->target;
+}
+
+/// view the robots' positions, which are stored right after the target's
+const struct pos* robotPositions(Simulation sim, size_t* k) {
+    *k = sim->k;
+    return &sim->cells[1];
+}
+
+/// view the robots
+Robot const* simulationRobots(Simulation sim, size_t* k) {
+    *k = sim->k;
+    return sim->robots;
+}
+
+/// view a robot's explored map
+const bool* exploredMap(Simulation sim, size_t id) {
+    return sim->robots[id]->explored;
+}
+
+/// log the message, map exchange, election and stall counters
+void printSimulationStats(Simulation sim) {
+    printNetworkStats(sim->net);
+    ExchangeStats* ex = &sim->exchange->stats;
+    log_info("Map deltas delivered: %zu (%zu bytes), %zu runs of %zu cells (%.2f bytes per cell), %zu cells new to their receiver\n",
+             ex->packets, ex->bytes, ex->runs, ex->cells, ex->cells ? (double) ex->bytes / (double) ex->cells : 0.0, ex->merged);
+    unsigned long long queries = atomic_load(&sim->landmarks->queries);
+    unsigned long long expanded = atomic_load(&sim->landmarks->expanded);
+    log_info("Path queries: %llu (%.1f cells expanded per query)\n", queries,
+             queries ? (double) expanded / (double) queries : 0.0);
+    log_info("Leader elections: %zu (%d rounds, %llu messages)\n", sim->elections, sim->election_rounds, sim->election_messages);
+    log_info("Stalled robots resolved: %zu%s\n", sim->stalls, sim->timed_out ? ", round limit reached" : "");
+}
+
+/// free all memory held by a simulation
+void freeSimulation(Simulation sim) {
+    for(size_t j=0; j<sim->k; j++) {
+        freeRobot(sim->robots[j], sim->l, sim->b);
     }
-    free(robots);
-    free(objects);
-    return EXIT_SUCCESS;
+    safefree(sim->robots);
+    safefree(sim->objects);
+    safefree(sim->cells);
+    freeNetwork(sim->net);
+    freeSpatial(sim->spatial);
+    freeExchange(sim->exchange);
+    freeLandmarks(sim->landmarks);
+    safefree(sim);
 }
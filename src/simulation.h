@@ -4,13 +4,88 @@
 #include <glob.h>
 #include "robot.h"
 
-/// runs the robot-attack simulation on a grid of size {l}x{b} with {k} robots and {e} malicious robots
+/// phases of a simulation
+#define PHASE_FINISHED   -1
+#define PHASE_EXPLORE     0
+#define PHASE_TRANSITION  1
+#define PHASE_ATTACK      2
+
+/// how a robot which stopped making progress during the attack phase is resolved
+typedef enum stall_strategy {
+    STALL_SWAP,         // swap assignments with the robot standing on its assignment
+    STALL_YIELD,        // give up the assignment and hold the current position
+    STALL_REASSIGN      // take the free cell closest to the target that it can still reach
+} StallStrategy;
+
+/// opaque handle of a running simulation
+typedef struct simulation *Simulation;
+
+/// create a simulation on a grid of size {l}x{b} with {k} robots and {e} malicious robots
+/// the target and robots are placed using streams derived from the seed {s}
 /// @param l height dimension of the simulation grid
 /// @param b width dimension of the simulation grid
 /// @param k total number of robots to use in the simulation
 /// @param e number of robots which are malicious/compromised
 /// @param s the seed value
-/// @returns simulation exit code
-int run(size_t l, size_t b, size_t k, size_t e, long s);
+Simulation makeSimulation(size_t l, size_t b, size_t k, size_t e, long s);
+
+/// do up to {n} turns of the simulation, stopping early once it has finished
+/// the transition phase takes a turn of its own but does not count as a round
+/// @returns the number of turns done
+int stepSimulation(Simulation sim, int n);
+
+/// stop the robot with ID {id} for good, e.g. to see the robots replace a lost leader;
+/// it stays on the grid as an obstacle and takes no further part in the simulation
+void crashRobot(Simulation sim, size_t id);
+
+/// get the ID of the current leader
+size_t simulationLeader(Simulation sim);
+
+/// choose which moves a robot can make in one round, by default any of its 8 neighboring cells;
+/// must be chosen before the attack phase starts, which keeps the moves it started with
+void setNeighborhood(Simulation sim, Neighborhood moves);
+
+/// choose how stalled robots are resolved, by default they swap assignments
+void setStallStrategy(Simulation sim, StallStrategy strategy);
+
+/// finish the simulation after {max_rounds} rounds even if the robots have not settled
+/// the default limit is 2*l*b + 2*(l+b) rounds
+void setRoundLimit(Simulation sim, int max_rounds);
+
+/// get the number of stalled robots resolved so far
+size_t simulationStalls(Simulation sim);
+
+/// whether the simulation was finished by the round limit rather than by the robots settling
+bool simulationTimedOut(Simulation sim);
+
+/// get the current phase (one of the PHASE_ constants)
+int simulationPhase(Simulation sim);
+
+/// get the number of exploration and attack rounds done so far
+int simulationRound(Simulation sim);
+
+/// get the height {l} and width {b} of the simulation grid
+void simulationSize(Simulation sim, size_t* l, size_t* b);
+
+/// get a read-only view of the target's position
+const struct pos* targetPosition(Simulation sim);
+
+/// get a read-only view of every robot's position, indexed by robot ID
+/// the view stays valid and up to date for the lifetime of the simulation
+/// @param k set to the number of robots
+const struct pos* robotPositions(Simulation sim, size_t* k);
+
+/// get a read-only view of the robots, indexed by robot ID
+Robot const* simulationRobots(Simulation sim, size_t* k);
+
+/// get a read-only view of the explored map of the robot with ID {id},
+/// indexed y*b+x; the view stays valid for the lifetime of the simulation
+const bool* exploredMap(Simulation sim, size_t id);
+
+/// log the message, map exchange, election and stall counters of the simulation
+void printSimulationStats(Simulation sim);
+
+/// free a simulation and everything it owns
+void freeSimulation(Simulation sim);
 
 #endif //CSCI251_PROJECT3_SIMULATION_H
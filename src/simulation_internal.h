@@ -0,0 +1,37 @@
+#ifndef CSCI251_PROJECT3_SIMULATION_INTERNAL_H
+#define CSCI251_PROJECT3_SIMULATION_INTERNAL_H
+
+#include "simulation.h"
+
+/// complete state of a simulation between two turns
+/// only the library's own modules see the layout, clients use the functions in simulation.h
+struct simulation {
+    size_t l;               // height dimension of the simulation grid
+    size_t b;               // width dimension of the simulation grid
+    size_t k;               // total number of robots
+    size_t e;               // number of malicious robots
+    long s;                 // the seed value
+    int phase;              // 0 exploration, 1 transition, 2 attack, -1 finished
+    int round;              // number of exploration and attack rounds done
+    struct pos* cells;      // contiguous positions, the target followed by every robot
+    Position target;        // the target's position, &cells[0]
+    Position* objects;      // positions taken on the grid, objects[j] == &cells[j]
+    size_t o_size;
+    Robot* robots;
+    Robot leader;
+    int silent_turns;       // turns in a row the robots did not hear the leader's heartbeat
+    size_t elections;       // leader elections held, including the first
+    int election_rounds;    // message rounds spent on elections
+    unsigned long long election_messages;   // messages delivered during elections
+    Network net;
+    struct spatial* spatial;    // buckets of the robots' positions, &cells[1] indexed by ID
+    struct exchange* exchange;  // map deltas passed between nearby robots during exploration
+    Neighborhood moves;     // moves a robot can make in one round
+    struct landmarks* landmarks;    // lower bounds on path lengths, placed around the crashed robots
+    StallStrategy stall_strategy;
+    int max_rounds;         // the simulation is finished after this many rounds
+    size_t stalls;          // stalled robots resolved so far
+    bool timed_out;         // finished by max_rounds
+};
+
+#endif //CSCI251_PROJECT3_SIMULATION_INTERNAL_H
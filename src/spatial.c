@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include "spatial.h"
+
+/// bucket of a grid position
+static size_t bucketOf(Spatial spatial, const struct pos* pos) {
+    return (size_t) pos->y / SPATIAL_BUCKET * spatial->cols + (size_t) pos->x / SPATIAL_BUCKET;
+}
+
+static void linkRobot(Spatial spatial, size_t id, size_t bucket) {
+    spatial->bucket[id] = bucket;
+    spatial->prev[id]   = NO_ROBOT;
+    spatial->next[id]   = spatial->heads[bucket];
+    if (spatial->heads[bucket] != NO_ROBOT) {
+        spatial->prev[spatial->heads[bucket]] = id;
+    }
+    spatial->heads[bucket] = id;
+}
+
+static void unlinkRobot(Spatial spatial, size_t id) {
+    if (spatial->prev[id] != NO_ROBOT) {
+        spatial->next[spatial->prev[id]] = spatial->next[id];
+    } else {
+        spatial->heads[spatial->bucket[id]] = spatial->next[id];
+    }
+    if (spatial->next[id] != NO_ROBOT) {
+        spatial->prev[spatial->next[id]] = spatial->prev[id];
+    }
+}
+
+/// create a spatial hash
+Spatial makeSpatial(const struct pos* positions, size_t k, size_t l, size_t b) {
+    Spatial spatial = safemalloc(sizeof *spatial, MEM_SIMULATION);
+    spatial->positions = positions;
+    spatial->k         = k;
+    spatial->cols      = (b + SPATIAL_BUCKET - 1) / SPATIAL_BUCKET;
+    spatial->rows      = (l + SPATIAL_BUCKET - 1) / SPATIAL_BUCKET;
+    spatial->heads     = safemalloc(spatial->cols * spatial->rows * sizeof *(spatial->heads), MEM_SIMULATION);
+    spatial->next      = safemalloc(k * sizeof *(spatial->next), MEM_SIMULATION);
+    spatial->prev      = safemalloc(k * sizeof *(spatial->prev), MEM_SIMULATION);
+    spatial->bucket    = safemalloc(k * sizeof *(spatial->bucket), MEM_SIMULATION);
+    for (size_t i=0; i<spatial->cols*spatial->rows; i++) {
+        spatial->heads[i] = NO_ROBOT;
+    }
+    for (size_t id=0; id<k; id++) {
+        linkRobot(spatial, id, bucketOf(spatial, &positions[id]));
+    }
+    return spatial;
+}
+
+/// free a spatial hash
+void freeSpatial(Spatial spatial) {
+    safefree(spatial->heads);
+    safefree(spatial->next);
+    safefree(spatial->prev);
+    safefree(spatial->bucket);
+    safefree(spatial);
+}
+
+/// relink a robot which moved
+void spatialUpdate(Spatial spatial, size_t id) {
+    size_t bucket = bucketOf(spatial, &spatial->positions[id]);
+    if (bucket != spatial->bucket[id]) {
+        unlinkRobot(spatial, id);
+        linkRobot(spatial, id, bucket);
+    }
+}
+
+/// find the robots near a position
+size_t spatialQuery(Spatial spatial, int x, int y, int r, size_t* out) {
+    // buckets overlapping the square [x-r, x+r] x [y-r, y+r], clamped to the grid
+    long x0 = (x - r) / SPATIAL_BUCKET, x1 = (x + r) / SPATIAL_BUCKET;
+    long y0 = (y - r) / SPATIAL_BUCKET, y1 = (y + r) / SPATIAL_BUCKET;
+    if (x - r < 0) { x0 = 0; }
+    if (y - r < 0) { y0 = 0; }
+    if (x1 >= (long) spatial->cols) { x1 = (long) spatial->cols - 1; }
+    if (y1 >= (long) spatial->rows) { y1 = (long) spatial->rows - 1; }
+
+    size_t n = 0;
+    for (long by=y0; by<=y1; by++) {
+        for (long bx=x0; bx<=x1; bx++) {
+            for (size_t id=spatial->heads[by*spatial->cols + bx]; id != NO_ROBOT; id=spatial->next[id]) {
+                const struct pos* pos = &spatial->positions[id];
+                if (abs(pos->x - x) <= r && abs(pos->y - y) <= r) {
+                    out[n++] = id;
+                }
+            }
+        }
+    }
+    return n;
+}
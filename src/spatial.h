@@ -0,0 +1,42 @@
+#ifndef CSCI251_PROJECT3_SPATIAL_H
+#define CSCI251_PROJECT3_SPATIAL_H
+
+#include <glob.h>
+#include "robot.h"
+
+/// side length (in grid cells) of the square buckets of a spatial hash
+#define SPATIAL_BUCKET 4
+
+/// marks the end of a bucket's list of robots
+#define NO_ROBOT ((size_t) -1)
+
+/// uniform grid of buckets over the simulation grid, each listing the robots standing in it
+/// robots are linked into their bucket through per-robot arrays, so moving one is O(1)
+typedef struct spatial {
+    const struct pos* positions;    // robot positions, indexed by ID
+    size_t k;
+    size_t cols;        // number of buckets across the grid
+    size_t rows;        // number of buckets down the grid
+    size_t* heads;      // first robot of every bucket, or NO_ROBOT
+    size_t* next;       // next robot in the same bucket, per robot ID
+    size_t* prev;       // previous robot in the same bucket, per robot ID
+    size_t* bucket;     // bucket the robot is linked into, per robot ID
+} *Spatial;
+
+/// create a spatial hash of the {k} robots at {positions} on a grid of size {l}x{b}
+/// {positions} is owned by the caller and read again on every update
+Spatial makeSpatial(const struct pos* positions, size_t k, size_t l, size_t b);
+
+/// free a spatial hash
+void freeSpatial(Spatial spatial);
+
+/// move the robot with ID {id} to the bucket of its current position
+void spatialUpdate(Spatial spatial, size_t id);
+
+/// find the robots within Chebyshev distance {r} of ({x}, {y})
+/// takes time proportional to the number of robots in the buckets overlapping the query
+/// @param out receives the IDs of the robots found, in no particular order; must have room for k
+/// @returns the number of robots found
+size_t spatialQuery(Spatial spatial, int x, int y, int r, size_t* out);
+
+#endif //CSCI251_PROJECT3_SPATIAL_H
@@ -10,12 +10,10 @@
 
 void clear() {
     printf("\033[2J");
-    fflush(stdout);
 }
 
 void put(char character) {
     putchar(character);
-    fflush(stdout);
 }
 
 void set_cur_pos(size_t rCursor, size_t cCursor) {
@@ -23,7 +21,10 @@ void set_cur_pos(size_t rCursor, size_t cCursor) {
 }
 
 /// updates the simulation's terminal display
-void update_display(size_t l, size_t b, size_t k, int phase, int round, Robot *robots, Position target) {
+/// the whole frame is buffered by stdio and written out with a single flush
+void update_display(size_t l, size_t b, size_t k, int phase, int round,
+                    const struct pos* positions, const bool* malicious, const struct pos* target,
+                    const char* status) {
     clear();
 
     /* make border */
@@ -54,9 +55,9 @@ void update_display(size_t l, size_t b, size_t k, int phase, int round, Robot *r
 
     /* put robots */
     for(size_t j=0; j<k; j++) {
-        struct pos *pos = robots[j]->self;
+        const struct pos *pos = &positions[j];
         set_cur_pos(l-(pos->y)+1, (pos->x)+2);
-        if(robots[j]->malicious) put(MALICIOUS_CHAR);
+        if(malicious[j]) put(MALICIOUS_CHAR);
         else put(ROBOT_CHAR);
     }
 
@@ -80,4 +81,8 @@ void update_display(size_t l, size_t b, size_t k, int phase, int round, Robot *r
             break;
     }
     set_cur_pos(l+4,0);
-}
\ No newline at end of file
+    if (status != NULL) {
+        printf("%s\n", status);
+    }
+    fflush(stdout);
+}
@@ -2,7 +2,11 @@
 #define CSCI251_PROJECT3_DISPLAY_H
 #include "../robot.h"
 
-void update_display(size_t l, size_t b, size_t k, int phase, int round, Robot *robots, Position target);
+/// draw the grid with the target and the robots at {positions}, malicious robots are marked
+/// {status}, if not NULL, is written on the line below the phase
+void update_display(size_t l, size_t b, size_t k, int phase, int round,
+                    const struct pos* positions, const bool* malicious, const struct pos* target,
+                    const char* status);
 
 
 #endif //CSCI251_PROJECT3_DISPLAY_H
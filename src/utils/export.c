@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include "export.h"
+#include "safemalloc.h"
+
+/// colors of the exported frames
+static const unsigned char BACKGROUND[3] = { 24, 24, 24 };
+static const unsigned char GRID_LINE[3]  = { 48, 48, 48 };
+static const unsigned char TARGET[3]     = { 250, 200, 40 };
+static const unsigned char ROBOT[3]      = { 66, 135, 245 };
+static const unsigned char MALICIOUS[3]  = { 230, 60, 60 };
+
+struct exporter {
+    int fd;
+    FILE* command;              // set if writing to a command started with popen
+    FrameFormat format;
+    size_t scale;
+    size_t l;
+    size_t b;
+    size_t k;
+    unsigned char* frame;       // header followed by the pixels, written with a single call
+    size_t size;                // bytes of {frame} written per frame
+    unsigned char* pixels;      // first pixel of {frame}
+    struct pos* drawn;          // robot positions in the current image, indexed by robot ID
+    struct pos drawn_target;
+    bool empty;                 // whether nothing was drawn yet
+    size_t frames;
+};
+
+/// open the destination of an exporter
+static bool open_destination(Exporter e, const char* dest) {
+    e->command = NULL;
+    if (dest[0] == '|') {
+        e->command = popen(dest + 1, "w");
+        if (e->command == NULL) {
+            return false;
+        }
+        e->fd = fileno(e->command);
+    } else if (dest[0] == '&') {
+        char* end;
+        long fd = strtol(dest + 1, &end, 10);
+        if (*end != '\0' || fd < 0 || fcntl((int) fd, F_GETFD) < 0) {
+            return false;
+        }
+        e->fd = (int) fd;
+    } else {
+        e->fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    return e->fd >= 0;
+}
+
+/// paint the cell ({x}, {y}) in {color}, keeping the grid lines when cells are large enough to show them
+static void draw_cell(Exporter e, int x, int y, const unsigned char color[3]) {
+    size_t width = e->b * e->scale;
+    size_t top = (e->l - 1 - (size_t) y) * e->scale, left = (size_t) x * e->scale;
+    bool lines = e->scale >= 4;
+    for (size_t r=0; r<e->scale; r++) {
+        unsigned char* px = e->pixels + ((top + r) * width + left) * 3;
+        for (size_t c=0; c<e->scale; c++, px+=3) {
+            const unsigned char* rgb = lines && (r == 0 || c == 0) ? GRID_LINE : color;
+            px[0] = rgb[0];
+            px[1] = rgb[1];
+            px[2] = rgb[2];
+        }
+    }
+}
+
+/// create an exporter
+Exporter make_exporter(const char* dest, FrameFormat format, size_t scale, size_t l, size_t b, size_t k) {
+    Exporter e = safemalloc(sizeof *e, MEM_DISPLAY);
+    if (!open_destination(e, dest)) {
+        safefree(e);
+        return NULL;
+    }
+    // a reader which goes away is reported by write() rather than killing the program
+    signal(SIGPIPE, SIG_IGN);
+
+    e->format = format;
+    e->scale  = scale;
+    e->l      = l;
+    e->b      = b;
+    e->k      = k;
+    e->empty  = true;
+    e->frames = 0;
+    e->drawn  = safemalloc(k * sizeof *(e->drawn), MEM_DISPLAY);
+
+    char header[64];
+    int header_len = 0;
+    if (format == FORMAT_PPM) {
+        header_len = snprintf(header, sizeof header, "P6\n%zu %zu\n255\n", b * scale, l * scale);
+    }
+    e->size   = (size_t) header_len + l * b * scale * scale * 3;
+    e->frame  = safemalloc(e->size, MEM_DISPLAY);
+    e->pixels = e->frame + header_len;
+    memcpy(e->frame, header, (size_t) header_len);
+    return e;
+}
+
+/// write a frame
+bool export_frame(Exporter e, const struct pos* positions, const bool* malicious, const struct pos* target) {
+    // only the cells which were painted last time need to be cleared
+    if (e->empty) {
+        for (size_t y=0; y<e->l; y++) {
+            for (size_t x=0; x<e->b; x++) {
+                draw_cell(e, (int) x, (int) y, BACKGROUND);
+            }
+        }
+        e->empty = false;
+    } else {
+        draw_cell(e, e->drawn_target.x, e->drawn_target.y, BACKGROUND);
+        for (size_t i=0; i<e->k; i++) {
+            draw_cell(e, e->drawn[i].x, e->drawn[i].y, BACKGROUND);
+        }
+    }
+    draw_cell(e, target->x, target->y, TARGET);
+    e->drawn_target = *target;
+    for (size_t i=0; i<e->k; i++) {
+        draw_cell(e, positions[i].x, positions[i].y, malicious[i] ? MALICIOUS : ROBOT);
+        e->drawn[i] = positions[i];
+    }
+
+    size_t written = 0;
+    while (written < e->size) {
+        ssize_t n = write(e->fd, e->frame + written, e->size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += (size_t) n;
+    }
+    e->frames++;
+    return true;
+}
+
+/// number of written frames
+size_t exported_frames(Exporter e) {
+    return e->frames;
+}
+
+/// free an exporter
+void free_exporter(Exporter e) {
+    if (e->command != NULL) {
+        pclose(e->command);
+    } else {
+        close(e->fd);
+    }
+    safefree(e->frame);
+    safefree(e->drawn);
+    safefree(e);
+}
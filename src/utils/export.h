@@ -0,0 +1,48 @@
+/**
+ * Raw video frame export
+ *
+ * Each round is rasterized into an RGB image with {scale}x{scale} pixels per
+ * grid cell and written to a file, a named pipe, an inherited file descriptor
+ * or the stdin of a command, e.g. an encoder:
+ *
+ *   ./main --headless --export '|ffmpeg -i - run.mp4'
+ *
+ * The image is kept between frames and only the cells which changed are
+ * redrawn, so exporting a frame allocates nothing and costs one write.
+ **/
+
+#ifndef CSCI251_PROJECT3_EXPORT_H
+#define CSCI251_PROJECT3_EXPORT_H
+
+#include <stdbool.h>
+#include "../robot.h"
+
+/// pixel layout of exported frames
+typedef enum frame_format {
+    FORMAT_PPM,     // binary PPM (P6): a short header followed by the pixels, readable by most tools
+    FORMAT_RGB      // bare 8-bit RGB pixels, row by row from the top, e.g. ffmpeg -f rawvideo -pix_fmt rgb24
+} FrameFormat;
+
+/// default number of pixels per grid cell along each side
+#define EXPORT_SCALE 8
+
+typedef struct exporter *Exporter;
+
+/// open an exporter for a {l}x{b} grid with {k} robots
+/// @param dest a file or named pipe, "&N" for the already open file descriptor N,
+///             or "|command" to start a command and write to its stdin
+/// @returns NULL if {dest} could not be opened
+Exporter make_exporter(const char* dest, FrameFormat format, size_t scale, size_t l, size_t b, size_t k);
+
+/// rasterize and write one frame, malicious robots are drawn in a different color
+/// @returns false if the frame could not be written, e.g. because the reader went away
+bool export_frame(Exporter exporter, const struct pos* positions, const bool* malicious,
+                  const struct pos* target);
+
+/// number of frames written so far
+size_t exported_frames(Exporter exporter);
+
+/// close the destination (waiting for a command to finish) and free the exporter
+void free_exporter(Exporter exporter);
+
+#endif //CSCI251_PROJECT3_EXPORT_H
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "log.h"
+
+/// number of lines the ring buffer holds, must be a power of two
+#define LOG_RING_SIZE 4096
+
+/// one formatted line in the ring buffer
+typedef struct log_line {
+    atomic_size_t seq;      // hands the slot between producers and the writer
+    char text[LOG_LINE_MAX];
+} LogLine;
+
+int log_verbosity = LOG_DEBUG;
+
+static LogLine ring[LOG_RING_SIZE];
+static atomic_size_t head;          // next slot a producer will claim
+static atomic_size_t written;       // lines the writer has flushed to stdout
+static atomic_ullong dropped;       // lines dropped because the ring was full
+static atomic_bool running;
+static atomic_bool stopping;
+static pthread_t writer;
+
+/// drain the ring buffer to stdout until the logger is stopped
+static void* log_writer(void* unused) {
+    size_t tail = 0;
+    struct timespec idle = { 0, 100000 };
+    for (;;) {
+        LogLine* line = &ring[tail & (LOG_RING_SIZE-1)];
+        if (atomic_load_explicit(&line->seq, memory_order_acquire) == tail+1) {
+            fputs(line->text, stdout);
+            atomic_store_explicit(&line->seq, tail + LOG_RING_SIZE, memory_order_release);
+            tail++;
+        } else {
+            // ring is empty, publish what was written so far
+            fflush(stdout);
+            atomic_store_explicit(&written, tail, memory_order_release);
+            if (atomic_load(&stopping) && atomic_load(&head) == tail) {
+                break;
+            }
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/// start the background writer
+void log_start(int verbosity) {
+    log_verbosity = verbosity;
+    for (size_t i=0; i<LOG_RING_SIZE; i++) {
+        atomic_init(&ring[i].seq, i);
+    }
+    atomic_store(&head, 0);
+    atomic_store(&written, 0);
+    atomic_store(&dropped, 0);
+    atomic_store(&stopping, false);
+    if (pthread_create(&writer, NULL, &log_writer, NULL) == 0) {
+        atomic_store(&running, true);
+    }
+}
+
+/// stop the background writer
+void log_stop(void) {
+    if (!atomic_load(&running)) {
+        return;
+    }
+    atomic_store(&stopping, true);
+    pthread_join(writer, NULL);
+    atomic_store(&running, false);
+    unsigned long long lost = atomic_load(&dropped);
+    if (lost > 0) {
+        fprintf(stderr, "%llu log lines dropped\n", lost);
+    }
+}
+
+/// wait until every line logged so far is written
+void log_flush(void) {
+    if (!atomic_load(&running)) {
+        fflush(stdout);
+        return;
+    }
+    size_t target = atomic_load(&head);
+    while (atomic_load_explicit(&written, memory_order_acquire) < target) {
+        sched_yield();
+    }
+}
+
+/// format a line into the ring buffer
+void log_write(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+
+    // claim a slot, dropping the line if the ring is full
+    size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+    LogLine* line;
+    for (;;) {
+        line = &ring[pos & (LOG_RING_SIZE-1)];
+        size_t seq = atomic_load_explicit(&line->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&head, &pos, pos+1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            va_end(args);
+            return;
+        } else {
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    vsnprintf(line->text, LOG_LINE_MAX, format, args);
+    va_end(args);
+    atomic_store_explicit(&line->seq, pos+1, memory_order_release);
+}
@@ -0,0 +1,56 @@
+/**
+ * Asynchronous buffered logging
+ *
+ * Log sites format their line straight into a bounded lock-free ring buffer
+ * which a background thread drains to stdout. Sites above LOG_COMPILE_LEVEL
+ * are removed by the compiler, sites above the runtime verbosity cost a
+ * single comparison, and a full ring drops lines instead of blocking.
+ **/
+
+#ifndef CSCI251_PROJECT3_LOG_H
+#define CSCI251_PROJECT3_LOG_H
+
+/// verbosity levels, each level includes all lower levels
+#define LOG_QUIET 0
+#define LOG_ERROR 1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+/// highest level compiled into the program
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+/// maximum length of a single log line, longer lines are truncated
+#define LOG_LINE_MAX 192
+
+/// current runtime verbosity
+extern int log_verbosity;
+
+/// log a printf-style line at {level} if it is enabled at compile time and runtime
+#define LOG(level, ...) do { \
+        if ((level) <= LOG_COMPILE_LEVEL && (level) <= log_verbosity) { \
+            log_write(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_error(...) LOG(LOG_ERROR, __VA_ARGS__)
+#define log_info(...)  LOG(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) LOG(LOG_DEBUG, __VA_ARGS__)
+
+/// start the background writer with the given runtime verbosity
+/// lines logged before the writer is started are printed synchronously
+void log_start(int verbosity);
+
+/// write out every pending line and stop the background writer
+void log_stop(void);
+
+/// block until every line logged so far has been written to stdout
+/// used before writing to the terminal directly so that output stays ordered
+void log_flush(void);
+
+/// format a line into the ring buffer, never blocks
+/// use the LOG macros instead so that disabled sites are skipped
+void log_write(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif //CSCI251_PROJECT3_LOG_H
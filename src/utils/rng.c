@@ -0,0 +1,26 @@
+#include "rng.h"
+
+/// SplitMix64 finalizer, a bijective mix of all 64 bits
+static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/// derive an independent stream key
+Rng rng_stream(uint64_t seed, RngSubsystem subsystem, uint64_t id) {
+    Rng rng;
+    rng.key     = mix(mix(mix(seed) + (uint64_t) subsystem) + id);
+    rng.counter = 0;
+    return rng;
+}
+
+/// the value at the stream's counter, then advance the counter
+uint64_t rng_next(Rng* rng) {
+    return mix(rng->key + 0x9e3779b97f4a7c15ULL * ++rng->counter);
+}
+
+/// scale 64 random bits into [0, n) with a multiply instead of a biased modulo
+uint64_t rng_below(Rng* rng, uint64_t n) {
+    return (uint64_t) (((unsigned __int128) rng_next(rng) * n) >> 64);
+}
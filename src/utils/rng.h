@@ -0,0 +1,35 @@
+/**
+ * Counter-based pseudo random number streams
+ *
+ * Every value is a SplitMix64 hash of a stream key and a counter, so a stream
+ * is fully described by two integers, independent streams never share state,
+ * and the same seed yields the same numbers on every platform and thread count.
+ **/
+
+#ifndef CSCI251_PROJECT3_RNG_H
+#define CSCI251_PROJECT3_RNG_H
+
+#include <stdint.h>
+
+/// subsystems which draw from their own streams
+typedef enum rng_subsystem {
+    RNG_PLACEMENT,  // initial placement of the target and robots
+    RNG_ROBOT       // per-robot decisions, one stream per robot ID
+} RngSubsystem;
+
+/// a single random stream
+typedef struct rng {
+    uint64_t key;       // identifies the stream
+    uint64_t counter;   // number of values drawn so far
+} Rng;
+
+/// derive the stream of {subsystem} number {id} from the simulation seed
+Rng rng_stream(uint64_t seed, RngSubsystem subsystem, uint64_t id);
+
+/// draw the next 64 random bits of the stream
+uint64_t rng_next(Rng* rng);
+
+/// draw a uniformly distributed number in [0, n)
+uint64_t rng_below(Rng* rng, uint64_t n);
+
+#endif //CSCI251_PROJECT3_RNG_H
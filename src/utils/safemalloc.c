@@ -7,46 +7,145 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include "safemalloc.h"
 
-void * safemalloc(size_t size)
+/// bookkeeping stored in front of every block, sized to keep blocks aligned
+typedef union header {
+    struct {
+        size_t size;
+        MemTag tag;
+    } info;
+    max_align_t align;
+} Header;
+
+/// counters of one subsystem
+typedef struct usage {
+    atomic_size_t live;         // bytes currently allocated
+    atomic_size_t peak;         // highest value live has reached
+    atomic_ullong allocs;       // malloc/calloc calls
+    atomic_ullong reallocs;     // realloc calls
+    atomic_ullong frees;        // free calls
+} Usage;
+
+static const char* tag_names[MEM_TAGS] = {
+    "simulation", "robots", "pathfinding", "planning", "messaging", "consensus", "checkpoint", "display"
+};
+
+static Usage usage[MEM_TAGS];
+static Usage total;
+
+/// raise a peak counter to at least {value}
+static void raise_peak(atomic_size_t* peak, size_t value) {
+    size_t old = atomic_load_explicit(peak, memory_order_relaxed);
+    while (old < value && !atomic_compare_exchange_weak_explicit(peak, &old, value,
+                                                                 memory_order_relaxed, memory_order_relaxed));
+}
+
+static void account(MemTag tag, size_t added, size_t removed) {
+    size_t live = atomic_fetch_add_explicit(&usage[tag].live, added - removed, memory_order_relaxed) + added - removed;
+    raise_peak(&usage[tag].peak, live);
+    live = atomic_fetch_add_explicit(&total.live, added - removed, memory_order_relaxed) + added - removed;
+    raise_peak(&total.peak, live);
+}
+
+static void * out_of_memory(void)
 {
-    void* ptr = malloc(size);
-    if(ptr == NULL)
+    printf("Failed to allocate memory! Exiting application...");
+    exit(EXIT_FAILURE);
+}
+
+/// fill in the header of a new block and return the user pointer
+static void * track(Header* header, size_t size, MemTag tag)
+{
+    header->info.size = size;
+    header->info.tag  = tag;
+    account(tag, size, 0);
+    return header + 1;
+}
+
+void * safemalloc(size_t size, MemTag tag)
+{
+    Header* header = malloc(sizeof *header + size);
+    if(header == NULL)
     {
-        printf("Failed to allocate memory! Exiting application...");
-        exit(EXIT_FAILURE);
+        return out_of_memory();
     }
-    else
+    atomic_fetch_add_explicit(&usage[tag].allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total.allocs, 1, memory_order_relaxed);
+    return track(header, size, tag);
+}
+
+void * safecalloc(size_t num, size_t size, MemTag tag)
+{
+    if(size != 0 && num > (SIZE_MAX - sizeof(Header)) / size)
+    {
+        return out_of_memory();
+    }
+    Header* header = calloc(1, sizeof *header + num*size);
+    if(header == NULL)
     {
-        return ptr;
+        return out_of_memory();
     }
+    atomic_fetch_add_explicit(&usage[tag].allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total.allocs, 1, memory_order_relaxed);
+    return track(header, num*size, tag);
 }
 
-void * safecalloc(size_t num, size_t size)
+void * saferealloc(void *ptr, size_t size, MemTag tag)
 {
-    void* ptr = calloc(num, size);
     if(ptr == NULL)
     {
-        printf("Failed to allocate memory! Exiting application...");
-        exit(EXIT_FAILURE);
+        return safemalloc(size, tag);
     }
-    else
+    Header* header = (Header*) ptr - 1;
+    size_t old_size = header->info.size;
+    tag = header->info.tag;
+    Header* newheader = realloc(header, sizeof *newheader + size);
+    if(newheader == NULL)
     {
-        return ptr;
+        return out_of_memory();
     }
+    atomic_fetch_add_explicit(&usage[tag].reallocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total.reallocs, 1, memory_order_relaxed);
+    account(tag, 0, old_size);
+    return track(newheader, size, tag);
 }
 
-void * saferealloc(void *ptr, size_t size)
+void safefree(void *ptr)
 {
-    void* newptr = realloc(ptr, size);
-    if(newptr == NULL)
+    if(ptr == NULL)
     {
-        printf("Failed to allocate memory! Exiting application...");
-        exit(EXIT_FAILURE);
+        return;
     }
-    else
+    Header* header = (Header*) ptr - 1;
+    atomic_fetch_add_explicit(&usage[header->info.tag].frees, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total.frees, 1, memory_order_relaxed);
+    account(header->info.tag, 0, header->info.size);
+    free(header);
+}
+
+size_t memory_peak(void)
+{
+    return atomic_load(&total.peak);
+}
+
+static void print_usage(FILE *out, const char* name, Usage* u)
+{
+    fprintf(out, "  %-12s %14zu %14zu %12llu %12llu %12llu\n", name,
+            atomic_load(&u->live), atomic_load(&u->peak),
+            atomic_load(&u->allocs), atomic_load(&u->reallocs), atomic_load(&u->frees));
+}
+
+void print_memory_report(FILE *out)
+{
+    fprintf(out, "Memory usage:\n");
+    fprintf(out, "  %-12s %14s %14s %12s %12s %12s\n", "subsystem", "live bytes", "peak bytes",
+            "allocs", "reallocs", "frees");
+    for(int tag=0; tag<MEM_TAGS; tag++)
     {
-        return newptr;
+        print_usage(out, tag_names[tag], &usage[tag]);
     }
+    print_usage(out, "total", &total);
 }
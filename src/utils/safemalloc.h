@@ -4,20 +4,48 @@
  * date: 2017-09-24
  *
  * Malloc, calloc, and realloc wrappers
+ *
+ * Every allocation is tagged with the subsystem it belongs to. The wrappers
+ * keep live bytes, peak bytes and call counts per subsystem, so memory must
+ * be released with safefree() rather than free().
  **/
 
 #include <stddef.h>
+#include <stdio.h>
 
 #ifndef SAFEMALLOC_H
 #define SAFEMALLOC_H
 
+/// subsystems memory is accounted to
+typedef enum mem_tag {
+    MEM_SIMULATION,     // simulation handle and placement
+    MEM_ROBOTS,         // robots, their buffers and explored maps
+    MEM_PATHFINDING,    // breadth-first search
+    MEM_PLANNING,       // assignment, exploration targets and incremental replanning
+    MEM_MESSAGING,      // mailboxes and broadcast log
+    MEM_CONSENSUS,      // target agreement and leader election
+    MEM_CHECKPOINT,     // snapshot buffers
+    MEM_DISPLAY,        // terminal and frame output
+    MEM_TAGS            // number of tags
+} MemTag;
+
 /// malloc() which will never return null
-void * safemalloc(size_t size);
+void * safemalloc(size_t size, MemTag tag);
 
 /// calloc() which will never return null
-void * safecalloc(size_t num, size_t size);
+void * safecalloc(size_t num, size_t size, MemTag tag);
+
+/// realloc() which will never return null, the block keeps its tag
+/// a NULL {ptr} allocates a new block tagged with {tag}
+void * saferealloc(void *ptr, size_t size, MemTag tag);
+
+/// free() for memory from the wrappers above, NULL is ignored
+void safefree(void *ptr);
+
+/// highest number of bytes allocated at once, over all subsystems
+size_t memory_peak(void);
 
-/// realloc() which will never return null
-void * saferealloc(void *ptr, size_t size);
+/// print live bytes, peak bytes and call counts of every subsystem
+void print_memory_report(FILE *out);
 
 #endif //SAFEMALLOC_H
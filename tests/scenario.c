@@ -0,0 +1,165 @@
+/**
+ * End-to-end scenario check
+ *
+ * Runs one scenario of a scenario file headless through the robotsim library and
+ * compares its rounds per phase, wall time and peak memory with the baseline recorded
+ * on the scenario's line. Used by CTest, one test per scenario; with --record the
+ * measured values are printed as a new baseline line instead.
+ **/
+
+#include <glob.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "simulation.h"
+#include "utils/log.h"
+#include "utils/safemalloc.h"
+
+/// one line of the scenario file
+typedef struct scenario {
+    char name[64];
+    size_t l;
+    size_t b;
+    size_t k;
+    size_t e;
+    long s;
+    int moves;          // 4 or 8
+    int crash;          // round after which the leader crashes, -1 for never
+    int explore;        // baseline exploration rounds
+    int attack;         // baseline attack rounds
+    double ms;          // baseline wall time
+    size_t peak_kb;     // baseline peak allocated memory
+} Scenario;
+
+/// measurements of one run
+typedef struct outcome {
+    int explore;
+    int attack;
+    double ms;
+    size_t peak_kb;
+    bool timed_out;
+} Outcome;
+
+/// find the scenario called {name}, lines starting with '#' are comments
+/// @returns false if the file has no such scenario
+static bool readScenario(const char* path, const char* name, Scenario* sc) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Cannot open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    char line[256];
+    bool found = false;
+    while (!found && fgets(line, sizeof line, file) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        int fields = sscanf(line, "%63s %zu %zu %zu %zu %ld %d %d %d %d %lf %zu", sc->name, &sc->l, &sc->b,
+                            &sc->k, &sc->e, &sc->s, &sc->moves, &sc->crash, &sc->explore, &sc->attack,
+                            &sc->ms, &sc->peak_kb);
+        found = fields == 12 && strcmp(sc->name, name) == 0;
+    }
+    fclose(file);
+    return found;
+}
+
+static double elapsedMs(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) * 1e3 + (double) (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/// run a scenario to the end, the way main does with --headless
+static Outcome runScenario(const Scenario* sc) {
+    Outcome out = { 0, 0, 0.0, 0, false };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Simulation sim = makeSimulation(sc->l, sc->b, sc->k, sc->e, sc->s);
+    setNeighborhood(sim, sc->moves == 4 ? NEIGHBORHOOD_4 : NEIGHBORHOOD_8);
+    int crash = sc->crash;
+    int phase = simulationPhase(sim);
+    while (phase != PHASE_FINISHED) {
+        bool exploring = phase == PHASE_EXPLORE;
+        stepSimulation(sim, 1);
+        phase = simulationPhase(sim);
+        if (exploring) {
+            out.explore = simulationRound(sim);
+        }
+        if (crash >= 0 && simulationRound(sim) >= crash && phase != PHASE_FINISHED) {
+            crashRobot(sim, simulationLeader(sim));
+            crash = -1;
+        }
+    }
+    out.attack    = simulationRound(sim) - out.explore;
+    out.timed_out = simulationTimedOut(sim);
+    out.ms        = elapsedMs(&start);
+    out.peak_kb   = (memory_peak() + 1023) / 1024;
+    freeSimulation(sim);
+    return out;
+}
+
+/// compare a measurement with its baseline, round counts are exact so improving on one is pointed out
+/// @returns true if it is within {limit}
+static bool check(const char* what, double value, double baseline, double limit, const char* unit) {
+    bool ok = value <= limit;
+    bool better = value < baseline && strcmp(unit, "rounds") == 0;
+    printf("  %-12s %12.1f %s  baseline %12.1f, limit %12.1f%s\n", what, value, unit, baseline, limit,
+           !ok ? "  REGRESSED" : better ? "  (better, consider --record)" : "");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s file name [--record] [--time-tolerance f] [--memory-tolerance f] "
+                        "[--round-tolerance percent]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    bool record = false;
+    double time_tolerance = 3.0, memory_tolerance = 1.1, round_tolerance = 0.0;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) {
+            record = true;
+        } else if (strcmp(argv[i], "--time-tolerance") == 0 && i+1 < argc) {
+            time_tolerance = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--memory-tolerance") == 0 && i+1 < argc) {
+            memory_tolerance = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--round-tolerance") == 0 && i+1 < argc) {
+            round_tolerance = strtod(argv[++i], NULL);
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Scenario sc;
+    if (!readScenario(argv[1], argv[2], &sc)) {
+        printf("No scenario %s in %s\n", argv[2], argv[1]);
+        return EXIT_FAILURE;
+    }
+    log_start(LOG_ERROR);
+    Outcome out = runScenario(&sc);
+    log_stop();
+
+    if (record) {
+        printf("%-16s %6zu %5zu %5zu %3zu %5ld %2d %6d %8d %8d %10.0f %9zu\n", sc.name, sc.l, sc.b, sc.k, sc.e, sc.s,
+               sc.moves, sc.crash, out.explore, out.attack, out.ms, out.peak_kb);
+        return EXIT_SUCCESS;
+    }
+
+    // wall time gets some slack on top of the factor, short runs are mostly noise
+    int rounds = out.explore + out.attack;
+    printf("%s: %zux%zu, k=%zu, e=%zu, seed %ld, %d-connected, %.0f rounds per second\n", sc.name, sc.l, sc.b,
+           sc.k, sc.e, sc.s, sc.moves, out.ms > 0 ? 1e3 * rounds / out.ms : 0.0);
+    bool ok = !out.timed_out;
+    ok &= check("explore", out.explore, sc.explore, sc.explore * (1.0 + round_tolerance / 100.0), "rounds");
+    ok &= check("attack", out.attack, sc.attack, sc.attack * (1.0 + round_tolerance / 100.0), "rounds");
+    ok &= check("wall time", out.ms, sc.ms, sc.ms * time_tolerance + 100.0, "ms    ");
+    ok &= check("peak memory", (double) out.peak_kb, (double) sc.peak_kb, (double) sc.peak_kb * memory_tolerance,
+                "KB    ");
+    if (out.timed_out) {
+        printf("  round limit reached\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}